@@ -45,6 +45,7 @@ extern "C" {
 
 /********************** inclusions *******************************************/
 #include <stdint.h>
+#include <stdbool.h>
 
 /********************** macros ***********************************************/
 // Functional states
@@ -63,36 +64,119 @@ extern "C" {
 #define HIGH   (!LOW)
 #endif
 
+// Transport, only the selected one is built
+#define DISPLAY_BACKEND_GPIO_4_BITS (0)
+#define DISPLAY_BACKEND_GPIO_8_BITS (1)
+#define DISPLAY_BACKEND_PCF8574     (2)
+#define DISPLAY_BACKEND_SSD1306     (3)
+
+#ifndef DISPLAY_BACKEND
+#define DISPLAY_BACKEND (DISPLAY_BACKEND_PCF8574)
+#endif
+
+// Panel geometry, see display_geometry in display.c
+#define DISPLAY_GEOMETRY_16x2 (0)
+#define DISPLAY_GEOMETRY_20x2 (1)
+#define DISPLAY_GEOMETRY_20x4 (2)
+#define DISPLAY_GEOMETRY_40x4 (3)
+
+#ifndef DISPLAY_GEOMETRY
+#define DISPLAY_GEOMETRY (DISPLAY_GEOMETRY_20x4)
+#endif
+
+#if (DISPLAY_GEOMETRY == DISPLAY_GEOMETRY_16x2)
+#define DISPLAY_COLUMNS     16
+#define DISPLAY_ROWS         2
+#define DISPLAY_CONTROLLERS  1
+#elif (DISPLAY_GEOMETRY == DISPLAY_GEOMETRY_20x2)
+#define DISPLAY_COLUMNS     20
+#define DISPLAY_ROWS         2
+#define DISPLAY_CONTROLLERS  1
+#elif (DISPLAY_GEOMETRY == DISPLAY_GEOMETRY_20x4)
+#define DISPLAY_COLUMNS     20
+#define DISPLAY_ROWS         4
+#define DISPLAY_CONTROLLERS  1
+#elif (DISPLAY_GEOMETRY == DISPLAY_GEOMETRY_40x4)
+#define DISPLAY_COLUMNS     40
+#define DISPLAY_ROWS         4
+#define DISPLAY_CONTROLLERS  2
+#else
+#error "DISPLAY_GEOMETRY must be one of DISPLAY_GEOMETRY_16x2, DISPLAY_GEOMETRY_20x2, DISPLAY_GEOMETRY_20x4 or DISPLAY_GEOMETRY_40x4"
+#endif
+
+#define DISPLAY_CELLS (DISPLAY_COLUMNS * DISPLAY_ROWS)
+
+// Panels driven at once, each one with its own handle
+#ifndef DISPLAY_INSTANCES_MAX
+#if (DISPLAY_BACKEND == DISPLAY_BACKEND_PCF8574)
+#define DISPLAY_INSTANCES_MAX 3
+#else
+#define DISPLAY_INSTANCES_MAX 1
+#endif
+#endif
+
+// 8 bit write address of a PCF8574 with A2..A0 high
+#define DISPLAY_PCF8574_ADDRESS_DEFAULT 78
+// 8 bit write address of an SSD1306 with SA0 low
+#define DISPLAY_SSD1306_ADDRESS_DEFAULT 120
+
+#if (DISPLAY_BACKEND == DISPLAY_BACKEND_SSD1306)
+#define DISPLAY_ADDRESS_DEFAULT DISPLAY_SSD1306_ADDRESS_DEFAULT
+#else
+#define DISPLAY_ADDRESS_DEFAULT DISPLAY_PCF8574_ADDRESS_DEFAULT
+#endif
+
+// Budget of display_frame_flush_budget() that never runs out
+#define DISPLAY_FLUSH_BUDGET_UNLIMITED UINT32_MAX
+
+// CGRAM glyphs
+#define DISPLAY_GLYPH_SLOTS 8
+#define DISPLAY_GLYPH_ROWS  8
+#define DISPLAY_GLYPH_NONE  '\0'
+
 /********************** typedef **********************************************/
-typedef enum {
-     DISPLAY_CONNECTION_GPIO_4_BITS,
-     DISPLAY_CONNECTION_GPIO_8_BITS,
-     DISPLAY_CONNECTION_I2C_PCF8574_IO_EXPANDER
-} display_connection_t;
+typedef struct display display_t;
 
+/* 5x8 user defined character, one row per byte, bit 4 is the leftmost dot */
 typedef struct {
-   display_connection_t connection;
-} display_t;
+   uint8_t rows[DISPLAY_GLYPH_ROWS];
+} display_glyph_t;
 
+/* Where the rows of the panel live. A 40x4 panel is two 40x2 controllers,
+ * each one with its own enable line. */
 typedef struct {
-   int address;
-   uint8_t data;
-   bool display_pin_rs;
-   bool display_pin_rw;
-   bool display_pin_en;
-   bool display_pin_a;
-   bool display_pin_d4;
-   bool display_pin_d5;
-   bool display_pin_d6;
-   bool display_pin_d7;
-} pcf8574_t;
+    uint8_t columns;
+    uint8_t rows;
+    uint8_t controllers;
+
+    /* Every DDRAM address of a controller is a visible cell, so the address
+     * counter carries from the end of a row into the next one */
+    bool ring_is_visible;
+
+    uint8_t row_address[DISPLAY_ROWS];
+    uint8_t row_controller[DISPLAY_ROWS];
+
+    /* Rows in address counter order, controller 0 first */
+    uint8_t ring_row[DISPLAY_ROWS];
+} display_geometry_t;
 
 /********************** external data declaration ****************************/
+extern const display_geometry_t display_geometry;
 
 /********************** external functions declaration ***********************/
-void display_init(display_connection_t connection);
-void display_char_position_write(uint8_t char_position_x, uint8_t char_position_y);
-void display_string_write(const char * str);
+display_t * display_init(uint8_t bus_address);
+void display_update(void);
+bool display_is_ready(display_t *p_display);
+void display_char_position_write(display_t *p_display, uint8_t char_position_x, uint8_t char_position_y);
+void display_string_write(display_t *p_display, const char * str);
+void display_frame_string_write(display_t *p_display, uint8_t char_position_x, uint8_t char_position_y, const char * str);
+void display_frame_flush(display_t *p_display);
+bool display_frame_flush_budget(display_t *p_display, uint32_t budget);
+bool display_address_counter_read(display_t *p_display, uint8_t *p_char_position_x, uint8_t *p_char_position_y);
+void display_cursor_show(display_t *p_display, uint8_t char_position_x, uint8_t char_position_y, bool blink);
+void display_cursor_hide(display_t *p_display);
+char display_glyph_acquire(display_t *p_display, const display_glyph_t * glyph);
+void display_glyph_release(display_t *p_display, char character);
 void keep_alive();
 
 /********************** End of CPP guard *************************************/
@@ -0,0 +1,152 @@
+/*
+ * Copyright (c) 2024 Manuel Collazo <mcollazo@fi.uba.ar>.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @file   : display_backend.h
+ * @date   : Ago 14, 2024
+ * @author : Manuel Collazo <mcollazo@fi.uba.ar>
+ * @version	v1.0.0
+ */
+
+#ifndef _DISPLAY_BACKEND_H_
+#define _DISPLAY_BACKEND_H_
+
+/********************** CPP guard ********************************************/
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/********************** inclusions *******************************************/
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "display.h"
+
+/********************** macros ***********************************************/
+#define DISPLAY_RS_INSTRUCTION 0
+#define DISPLAY_RS_DATA        1
+
+/* Cost of a SET_DDRAM_ADDR command and of a data write, used to decide
+ * whether to re-send clean cells or to move the address counter. Expander
+ * costs are bus bytes, RS settle bytes around the command included. GPIO
+ * costs are controller instruction times. The SSD1306 interprets the
+ * instructions locally and only the pixels they change reach the bus, a
+ * cell is 6 columns of one page and a row window costs 6 addressing
+ * commands and the control bytes of its two transfers. */
+#ifndef DISPLAY_PCF8574_ADDRESS_COST
+#define DISPLAY_PCF8574_ADDRESS_COST 6
+#endif
+#ifndef DISPLAY_PCF8574_DATA_COST
+#define DISPLAY_PCF8574_DATA_COST    4
+#endif
+#ifndef DISPLAY_GPIO_ADDRESS_COST
+#define DISPLAY_GPIO_ADDRESS_COST    1
+#endif
+#ifndef DISPLAY_GPIO_DATA_COST
+#define DISPLAY_GPIO_DATA_COST       1
+#endif
+#ifndef DISPLAY_SSD1306_ADDRESS_COST
+#define DISPLAY_SSD1306_ADDRESS_COST 8
+#endif
+#ifndef DISPLAY_SSD1306_DATA_COST
+#define DISPLAY_SSD1306_DATA_COST    6
+#endif
+
+/* Drive I2C1 and its DMA channel through the registers instead of the HAL
+ * I2C state machine. The I2C1 interrupt handlers then hand over to
+ * display_backend_i2c_ev_irq() and display_backend_i2c_er_irq(). */
+#ifndef DISPLAY_PCF8574_I2C_LL
+#define DISPLAY_PCF8574_I2C_LL 0
+#endif
+
+#if (DISPLAY_BACKEND == DISPLAY_BACKEND_PCF8574)
+#define DISPLAY_BACKEND_ADDRESS_COST DISPLAY_PCF8574_ADDRESS_COST
+#define DISPLAY_BACKEND_DATA_COST    DISPLAY_PCF8574_DATA_COST
+#define DISPLAY_BACKEND_CURSOR_COST  0
+#elif ((DISPLAY_BACKEND == DISPLAY_BACKEND_GPIO_4_BITS) || (DISPLAY_BACKEND == DISPLAY_BACKEND_GPIO_8_BITS))
+#define DISPLAY_BACKEND_ADDRESS_COST DISPLAY_GPIO_ADDRESS_COST
+#define DISPLAY_BACKEND_DATA_COST    DISPLAY_GPIO_DATA_COST
+#define DISPLAY_BACKEND_CURSOR_COST  0
+#elif (DISPLAY_BACKEND == DISPLAY_BACKEND_SSD1306)
+#define DISPLAY_BACKEND_ADDRESS_COST DISPLAY_SSD1306_ADDRESS_COST
+#define DISPLAY_BACKEND_DATA_COST    DISPLAY_SSD1306_DATA_COST
+#define DISPLAY_BACKEND_CURSOR_COST  (DISPLAY_SSD1306_ADDRESS_COST + DISPLAY_SSD1306_DATA_COST)
+#else
+#error "DISPLAY_BACKEND must be one of DISPLAY_BACKEND_GPIO_4_BITS, DISPLAY_BACKEND_GPIO_8_BITS, DISPLAY_BACKEND_PCF8574 or DISPLAY_BACKEND_SSD1306"
+#endif
+
+/* Smallest budget of display_frame_flush_budget(), an address command and
+ * one character. A shown SSD1306 cursor also draws the cell it leaves and
+ * the one it lands on again, each in a row window of its own at worst. */
+#define DISPLAY_FLUSH_BUDGET_MIN (DISPLAY_BACKEND_ADDRESS_COST + DISPLAY_BACKEND_DATA_COST + 2 * DISPLAY_BACKEND_CURSOR_COST)
+
+/********************** typedef **********************************************/
+
+/********************** external data declaration ****************************/
+
+/********************** external functions declaration ***********************/
+/* Implemented by the selected transport, display_gpio.c, display_pcf8574.c
+ * or display_ssd1306.c. The id is the panel index, below
+ * DISPLAY_INSTANCES_MAX. Health and update are shared by every panel on
+ * the bus. Codes go to the controllers of the last selected enable line
+ * mask, bit 0 being the first controller. */
+void display_backend_init(uint8_t id, uint8_t bus_address);
+void display_backend_update(void);
+bool display_backend_is_healthy(void);
+void display_backend_controller_select(uint8_t id, uint8_t controllers);
+void display_backend_4_bits_mode_enter(uint8_t id);
+void display_backend_code_send(uint8_t id, bool type, uint8_t data_bus);
+uint32_t display_backend_code_cost(uint8_t id, bool type, uint8_t data_bus);
+void display_backend_wait_us(uint8_t id, uint32_t wait_us);
+void display_backend_flush(uint8_t id);
+bool display_backend_is_busy(uint8_t id);
+bool display_backend_address_counter_read(uint8_t id, uint8_t *p_address);
+void display_backend_backlight_write(uint8_t id, bool on);
+void display_backend_refresh(uint8_t id);
+
+#if (DISPLAY_BACKEND == DISPLAY_BACKEND_PCF8574) && (DISPLAY_PCF8574_I2C_LL == 1)
+void display_backend_i2c_ev_irq(void);
+void display_backend_i2c_er_irq(void);
+#endif
+
+/* Implemented by display.c */
+void display_delay_us(uint32_t delay_us);
+
+#if (DISPLAY_BACKEND == DISPLAY_BACKEND_PCF8574) || (DISPLAY_BACKEND == DISPLAY_BACKEND_SSD1306)
+/* Implemented by display_i2c.c, shared by the I2C transports */
+bool display_i2c_bus_recover(void);
+#endif
+
+/********************** End of CPP guard *************************************/
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _DISPLAY_BACKEND_H_ */
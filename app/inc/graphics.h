@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) 2024 Manuel Collazo <mcollazo@fi.uba.ar>.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @file   : graphics.h
+ * @date   : Ago 14, 2024
+ * @author : Manuel Collazo <mcollazo@fi.uba.ar>
+ * @version	v1.0.0
+ */
+
+#ifndef _GRAPHICS_H_
+#define _GRAPHICS_H_
+
+/********************** CPP guard ********************************************/
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/********************** inclusions *******************************************/
+#include <stdint.h>
+#include <stdbool.h>
+
+/********************** macros ***********************************************/
+#define GRAPHICS_WORD_BITS 32
+
+// Words of pixels needed by a surface, rows start on a word boundary
+#define GRAPHICS_SURFACE_STRIDE(width)        (((width) + GRAPHICS_WORD_BITS - 1) / GRAPHICS_WORD_BITS)
+#define GRAPHICS_SURFACE_WORDS(width, height) (GRAPHICS_SURFACE_STRIDE(width) * (height))
+
+/********************** typedef **********************************************/
+typedef enum {
+    GRAPHICS_OP_SET,
+    GRAPHICS_OP_CLEAR,
+    GRAPHICS_OP_XOR,
+    GRAPHICS_OP_COPY,
+} graphics_op_t;
+
+typedef struct {
+    int16_t x;
+    int16_t y;
+    int16_t width;
+    int16_t height;
+} graphics_rect_t;
+
+/* 1bpp pixels, row by row. Pixel x of a row is bit x % 32 of word x / 32.
+ * The dirty rectangle bounds every pixel written since the last clear. */
+typedef struct {
+    uint32_t *p_words;
+    uint16_t width;
+    uint16_t height;
+    uint16_t stride;
+    graphics_rect_t dirty;
+} graphics_surface_t;
+
+/********************** external data declaration ****************************/
+
+/********************** external functions declaration ***********************/
+void graphics_surface_init(graphics_surface_t *p_surface, uint32_t *p_words, uint16_t width, uint16_t height);
+void graphics_fill(graphics_surface_t *p_surface, bool on);
+void graphics_rect_fill(graphics_surface_t *p_surface, int16_t x, int16_t y, int16_t width, int16_t height, graphics_op_t op);
+void graphics_rect_draw(graphics_surface_t *p_surface, int16_t x, int16_t y, int16_t width, int16_t height, graphics_op_t op);
+void graphics_hline(graphics_surface_t *p_surface, int16_t x, int16_t y, int16_t width, graphics_op_t op);
+void graphics_vline(graphics_surface_t *p_surface, int16_t x, int16_t y, int16_t height, graphics_op_t op);
+void graphics_blit(graphics_surface_t *p_dst, int16_t x, int16_t y, const graphics_surface_t *p_src, const graphics_rect_t *p_area, graphics_op_t op);
+void graphics_glyph_draw(graphics_surface_t *p_surface, int16_t x, int16_t y, const uint8_t *p_rows, uint8_t width, uint8_t height, graphics_op_t op);
+bool graphics_pixel_get(const graphics_surface_t *p_surface, int16_t x, int16_t y);
+bool graphics_dirty_get(const graphics_surface_t *p_surface, graphics_rect_t *p_rect);
+void graphics_dirty_clear(graphics_surface_t *p_surface);
+void graphics_page_pack(const graphics_surface_t *p_surface, uint8_t page, uint8_t *p_columns);
+
+/********************** End of CPP guard *************************************/
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _GRAPHICS_H_ */
@@ -59,10 +59,14 @@ typedef struct menu_t  {
     menu_item_t *items;
     int item_count;
     int current_item;
+    int first_visible_item;
     struct menu_t* parent_menu;
 } menu_t;
 
 /********************** external data declaration ****************************/
+/* Bumped whenever a label is written, so lines formatted from a label can
+ * tell they are out of date */
+extern unsigned int menu_label_generation;
 
 /********************** external functions declaration ***********************/
 void menu_initialize(menu_t* menu, menu_t* parent_menu, menu_item_t* items, int item_count);
@@ -72,8 +76,11 @@ void menu_go_to_parent(menu_t** menu);
 void menu_select(menu_t** current_menu);
 int menu_get_items_count(menu_t* menu);
 char* menu_get_item_label(menu_t* menu, int index);
+void menu_set_item_label(menu_t* menu, int index, const char* label);
 void menu_initialize_default(menu_t* menu);
 int menu_get_current_item_index(menu_t* menu);
+void menu_viewport_update(menu_t* menu, int visible_rows);
+int menu_get_first_visible_item(menu_t* menu);
 
 /********************** End of CPP guard *************************************/
 #ifdef __cplusplus
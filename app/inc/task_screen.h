@@ -48,6 +48,13 @@ extern "C" {
 /********************** macros ***********************************************/
 
 /********************** typedef **********************************************/
+typedef struct
+{
+	uint32_t	rendered;	/* frames drawn */
+	uint32_t	skipped;	/* states replaced by a newer one before drawn */
+	uint32_t	late;		/* frames drawn over one refresh interval after
+							   their state was posted */
+} task_screen_frame_stats_t;
 
 /********************** external data declaration ****************************/
 extern uint32_t g_task_screen_cnt;
@@ -56,6 +63,9 @@ extern volatile uint32_t g_task_screen_tick;
 /********************** external functions declaration ***********************/
 extern void task_screen_init(void *parameters);
 extern void task_screen_update(void *parameters);
+extern void task_screen_frame_stats_get(task_screen_frame_stats_t *p_stats);
+/* To be called after a label is edited in place */
+extern void task_screen_line_cache_invalidate(void);
 
 /********************** End of CPP guard *************************************/
 #ifdef __cplusplus
@@ -44,10 +44,11 @@ extern "C" {
 #endif
 
 /********************** inclusions *******************************************/
+#include "display.h"
 
 /********************** macros ***********************************************/
-#define LCD_DISPLAY_HEIGHT 4
-#define LCD_DISPLAY_WIDTH 20
+#define LCD_DISPLAY_HEIGHT DISPLAY_ROWS
+#define LCD_DISPLAY_WIDTH DISPLAY_COLUMNS
 
 /********************** typedef **********************************************/
 
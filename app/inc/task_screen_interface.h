@@ -56,6 +56,7 @@ extern void init_queue_event_task_screen(void);
 extern void put_event_task_screen(task_screen_dta_t dta);
 extern task_screen_dta_t get_event_task_screen(void);
 extern bool any_event_task_screen(void);
+extern uint32_t superseded_events_task_screen(void);
 
 /********************** End of CPP guard *************************************/
 #ifdef __cplusplus
@@ -97,6 +97,9 @@ void app_init(void)
 
 	g_app_cnt = G_APP_CNT_INI;
 
+	/* Start the DWT cycle counter, used for sub-millisecond waits */
+	cycle_counter_init();
+
 	/* Print out: Application execution counter */
 	LOGGER_LOG(" %s = %d\r\n", GET_NAME(g_app_cnt), (int)g_app_cnt);
 
@@ -38,20 +38,25 @@
 
 /********************** inclusions *******************************************/
 #include <stdbool.h>
+#include <string.h>
 
 /* Project includes. */
 #include "main.h"
 
 /* Demo includes. */
+#include "dwt.h"
 
 /* Application & Tasks includes. */
 #include "display.h"
+#include "display_backend.h"
 
 /********************** macros and definitions *******************************/
 #define DISPLAY_IR_CLEAR_DISPLAY   0b00000001
+#define DISPLAY_IR_RETURN_HOME     0b00000010
 #define DISPLAY_IR_ENTRY_MODE_SET  0b00000100
 #define DISPLAY_IR_DISPLAY_CONTROL 0b00001000
 #define DISPLAY_IR_FUNCTION_SET    0b00100000
+#define DISPLAY_IR_SET_CGRAM_ADDR  0b01000000
 #define DISPLAY_IR_SET_DDRAM_ADDR  0b10000000
 
 #define DISPLAY_IR_ENTRY_MODE_SET_INCREMENT 0b00000010
@@ -73,239 +78,765 @@
 #define DISPLAY_IR_FUNCTION_SET_5x10DOTS 0b00000100
 #define DISPLAY_IR_FUNCTION_SET_5x8DOTS  0b00000000
 
-#define DISPLAY_20x4_LINE1_FIRST_CHARACTER_ADDRESS 0
-#define DISPLAY_20x4_LINE2_FIRST_CHARACTER_ADDRESS 64
-#define DISPLAY_20x4_LINE3_FIRST_CHARACTER_ADDRESS 20
-#define DISPLAY_20x4_LINE4_FIRST_CHARACTER_ADDRESS 84
-
-#define DISPLAY_RS_INSTRUCTION 0
-#define DISPLAY_RS_DATA        1
-
-#define DISPLAY_RW_WRITE 0
-#define DISPLAY_RW_READ  1
-
-#define DISPLAY_PIN_RS  4
-#define DISPLAY_PIN_RW  5
-#define DISPLAY_PIN_EN  6
-#define DISPLAY_PIN_D0  7
-#define DISPLAY_PIN_D1  8
-#define DISPLAY_PIN_D2  9
-#define DISPLAY_PIN_D3 10
-#define DISPLAY_PIN_D4 11
-#define DISPLAY_PIN_D5 12
-#define DISPLAY_PIN_D6 13
-#define DISPLAY_PIN_D7 14
-
-#define DISPLAY_PIN_A_PCF8574 3
-
-#define I2C1_SDA PB_9
-#define I2C1_SCL PB_8
-
-#define PCF8574_I2C_BUS_8BIT_WRITE_ADDRESS 78
+#define DISPLAY_LINE1_FIRST_CHARACTER_ADDRESS 0
+#define DISPLAY_LINE2_FIRST_CHARACTER_ADDRESS 64
+
+/* Cells behind each enable line, every controller drives as many rows */
+#define DISPLAY_CONTROLLER_CELLS (DISPLAY_CELLS / DISPLAY_CONTROLLERS)
+#define DISPLAY_CONTROLLER_ROWS  (DISPLAY_ROWS / DISPLAY_CONTROLLERS)
+#define DISPLAY_CONTROLLER_ALL   0xFF
+
+#define DISPLAY_ADDRESS_COUNTER_UNKNOWN 0xFF
+
+/* Character codes 8..15 show CGRAM slots 0..7, and unlike 0..7 can be
+ * embedded in strings */
+#define DISPLAY_GLYPH_FIRST_CHARACTER 8
+
+#define DISPLAY_BLANK_CHARACTER ' '
+
+/* Period of the idle transport state refresh done by keep_alive(), 0 to
+ * never refresh */
+#ifndef DISPLAY_STATE_REFRESH_INTERVAL_MS
+#define DISPLAY_STATE_REFRESH_INTERVAL_MS 1000
+#endif
+
+/* HD44780 wait classes, see display_timing_us */
+typedef enum {
+    DISPLAY_TIMING_INSTRUCTION,
+    DISPLAY_TIMING_CLEAR_HOME,
+    DISPLAY_TIMING_FUNCTION_SET_RETRY,
+    DISPLAY_TIMING_FUNCTION_SET_FIRST,
+    DISPLAY_TIMING_POWER_ON,
+} display_timing_t;
+
+typedef struct {
+    display_glyph_t glyph;
+    uint32_t last_use;
+    uint8_t references;
+    bool assigned;
+    bool uploaded;
+} display_glyph_slot_t;
+
+/* Initialization steps, each one runs once the wait of the previous one
+ * has elapsed */
+typedef enum {
+    ST_DISPLAY_INIT_FUNCTION_SET_1,
+    ST_DISPLAY_INIT_FUNCTION_SET_2,
+    ST_DISPLAY_INIT_FUNCTION_SET_3,
+    ST_DISPLAY_INIT_INTERFACE,
+    ST_DISPLAY_INIT_FUNCTION_SET_LINES,
+    ST_DISPLAY_INIT_DISPLAY_OFF,
+    ST_DISPLAY_INIT_CLEAR,
+    ST_DISPLAY_INIT_ENTRY_MODE,
+    ST_DISPLAY_INIT_DISPLAY_ON,
+    ST_DISPLAY_READY,
+    ST_DISPLAY_OFFLINE,
+} display_init_st_t;
+
+/* One panel, the transport state is kept by the backend under the same id */
+struct display {
+    uint8_t id;
+    bool in_use;
+
+    display_init_st_t init_state;
+    display_timing_t init_wait;
+    uint32_t init_wait_start;
+
+    /* Shadow copy of what the controller DDRAM currently shows, and the
+     * frame requested by the application. display_frame_flush() only sends
+     * the cells where both differ. Cells are stored in DDRAM address order,
+     * see display_geometry.ring_row, and each controller address counter as
+     * a cell index. */
+    char ddram_shadow[DISPLAY_CELLS];
+    char frame[DISPLAY_CELLS];
+    uint8_t address_counter[DISPLAY_CONTROLLERS];
+    uint8_t controller;
+
+    /* Where display_string_write() lands before the controller is ready */
+    uint8_t write_cell;
+
+    /* CGRAM slots, replaced least recently used first among the unreferenced */
+    display_glyph_slot_t glyph_slot[DISPLAY_GLYPH_SLOTS];
+    uint32_t glyph_use_count;
+
+    /* Hardware cursor, parked at its cell after every frame flush */
+    uint8_t control;
+    uint8_t cursor_cell;
+};
 
 /********************** internal data declaration ****************************/
-static display_t display;
-static pcf8574_t pcf8574;
-static bool initial_8_bit_communication_is_completed;
+static display_t display[DISPLAY_INSTANCES_MAX];
+
+static uint32_t display_refresh_tick;
 
 /********************** internal functions declaration ***********************/
-static void display_pin_write(uint8_t pin_name, int value);
-static void display_data_bus_write(uint8_t data_byte);
-static void display_code_write(bool type, uint8_t data_bus);
+static void display_code_write(display_t *p_display, bool type, uint8_t data_bus);
+static void display_shadow_clear(display_t *p_display);
+static bool display_init_step_is_due(display_t *p_display);
+static void display_init_step(display_t *p_display);
+static uint8_t display_cell_index(uint8_t char_position_x, uint8_t char_position_y);
+static uint8_t display_cell_from_address(uint8_t controller, uint8_t address);
+static uint8_t display_cell_next(uint8_t cell);
+static uint8_t display_cell_gap(uint8_t from, uint8_t to);
+static void display_controller_select(display_t *p_display, uint8_t controller);
+static void display_control_write(display_t *p_display);
+static bool display_budget_spend(display_t *p_display, uint32_t *p_budget, bool type, uint8_t data_bus);
+static bool display_frame_controller_flush(display_t *p_display, uint8_t controller, uint32_t *p_budget);
+static uint8_t display_address_instruction(uint8_t cell);
+static void display_address_counter_write(display_t *p_display, uint8_t cell);
+static void display_data_write(display_t *p_display, char character);
+static void display_glyph_upload(display_t *p_display, uint8_t slot);
+static void display_cursor_restore(display_t *p_display);
+static void display_wait(display_t *p_display, display_timing_t timing);
+static void display_instance_update(display_t *p_display);
 
 /********************** internal data definition *****************************/
 
+/* Worst case wait for each class, in microseconds (HD44780U datasheet at
+ * 270 kHz plus margin) */
+static const uint32_t display_timing_us[] = {
+    [DISPLAY_TIMING_INSTRUCTION]        = 40,
+    [DISPLAY_TIMING_CLEAR_HOME]         = 2000,
+    [DISPLAY_TIMING_FUNCTION_SET_RETRY] = 100,
+    [DISPLAY_TIMING_FUNCTION_SET_FIRST] = 4500,
+    [DISPLAY_TIMING_POWER_ON]           = 50000,
+};
+
 /********************** external data declaration ****************************/
-extern I2C_HandleTypeDef hi2c1;
+/* In 2 lines mode the address counter runs 0..39 then 64..103 and wraps.
+ * A 20x4 panel splits each line in two rows, which then follow each other
+ * as 1, 3, 2, 4. Narrower panels leave part of each line unseen. */
+const display_geometry_t display_geometry = {
+#if (DISPLAY_GEOMETRY == DISPLAY_GEOMETRY_20x4)
+    .columns = DISPLAY_COLUMNS,
+    .rows = DISPLAY_ROWS,
+    .controllers = DISPLAY_CONTROLLERS,
+    .ring_is_visible = true,
+    .row_address = {DISPLAY_LINE1_FIRST_CHARACTER_ADDRESS, DISPLAY_LINE2_FIRST_CHARACTER_ADDRESS,
+                    DISPLAY_LINE1_FIRST_CHARACTER_ADDRESS + DISPLAY_COLUMNS, DISPLAY_LINE2_FIRST_CHARACTER_ADDRESS + DISPLAY_COLUMNS},
+    .row_controller = {0, 0, 0, 0},
+    .ring_row = {0, 2, 1, 3},
+#elif (DISPLAY_GEOMETRY == DISPLAY_GEOMETRY_40x4)
+    .columns = DISPLAY_COLUMNS,
+    .rows = DISPLAY_ROWS,
+    .controllers = DISPLAY_CONTROLLERS,
+    .ring_is_visible = true,
+    .row_address = {DISPLAY_LINE1_FIRST_CHARACTER_ADDRESS, DISPLAY_LINE2_FIRST_CHARACTER_ADDRESS,
+                    DISPLAY_LINE1_FIRST_CHARACTER_ADDRESS, DISPLAY_LINE2_FIRST_CHARACTER_ADDRESS},
+    .row_controller = {0, 0, 1, 1},
+    .ring_row = {0, 1, 2, 3},
+#else
+    .columns = DISPLAY_COLUMNS,
+    .rows = DISPLAY_ROWS,
+    .controllers = DISPLAY_CONTROLLERS,
+    .ring_is_visible = false,
+    .row_address = {DISPLAY_LINE1_FIRST_CHARACTER_ADDRESS, DISPLAY_LINE2_FIRST_CHARACTER_ADDRESS},
+    .row_controller = {0, 0},
+    .ring_row = {0, 1},
+#endif
+};
 
 /********************** internal functions definition ************************/
-static void display_code_write(bool type, uint8_t data_bus)
+static void display_code_write(display_t *p_display, bool type, uint8_t data_bus)
 {
-    if (type == DISPLAY_RS_INSTRUCTION)
-        display_pin_write(DISPLAY_PIN_RS, DISPLAY_RS_INSTRUCTION);
+    display_backend_code_send(p_display->id, type, data_bus);
+
+    /* Clear display and return home are the only slow instructions */
+    if (type == DISPLAY_RS_INSTRUCTION && data_bus <= (DISPLAY_IR_CLEAR_DISPLAY | DISPLAY_IR_RETURN_HOME))
+        display_wait(p_display, DISPLAY_TIMING_CLEAR_HOME);
     else
-        display_pin_write(DISPLAY_PIN_RS, DISPLAY_RS_DATA);
-    display_pin_write(DISPLAY_PIN_RW, DISPLAY_RW_WRITE);
-    display_data_bus_write(data_bus);
-}
-
-static void display_pin_write(uint8_t pin_name, int value)
-{
-	switch (display.connection) {
-		case DISPLAY_CONNECTION_GPIO_8_BITS:
-			switch (pin_name) {
-				case DISPLAY_PIN_D0: HAL_GPIO_WritePin(D2_GPIO_Port,  D2_Pin,  value);   break;
-				case DISPLAY_PIN_D1: HAL_GPIO_WritePin(D4_GPIO_Port,  D4_Pin,  value);   break;
-				case DISPLAY_PIN_D2: HAL_GPIO_WritePin(D5_GPIO_Port,  D5_Pin,  value);   break;
-				case DISPLAY_PIN_D3: HAL_GPIO_WritePin(D6_GPIO_Port,  D6_Pin,  value);   break;
-				case DISPLAY_PIN_D4: HAL_GPIO_WritePin(D7_GPIO_Port,  D7_Pin,  value);   break;
-				case DISPLAY_PIN_D5: HAL_GPIO_WritePin(D8_GPIO_Port,  D8_Pin,  value);   break;
-				case DISPLAY_PIN_D6: HAL_GPIO_WritePin(D9_GPIO_Port,  D9_Pin,  value);   break;
-				case DISPLAY_PIN_D7: HAL_GPIO_WritePin(D10_GPIO_Port, D10_Pin, value);   break;
-				case DISPLAY_PIN_RS: HAL_GPIO_WritePin(D11_GPIO_Port, D11_Pin, value);   break;
-				case DISPLAY_PIN_EN: HAL_GPIO_WritePin(D12_GPIO_Port, D12_Pin, value);   break;
-				case DISPLAY_PIN_RW: break;
-				default: break;
-			}
-			break;
-		case DISPLAY_CONNECTION_GPIO_4_BITS:
-			switch (pin_name) {
-				case DISPLAY_PIN_D4: HAL_GPIO_WritePin(D7_GPIO_Port,  D7_Pin,  value);   break;
-				case DISPLAY_PIN_D5: HAL_GPIO_WritePin(D8_GPIO_Port,  D8_Pin,  value);   break;
-				case DISPLAY_PIN_D6: HAL_GPIO_WritePin(D9_GPIO_Port,  D9_Pin,  value);   break;
-				case DISPLAY_PIN_D7: HAL_GPIO_WritePin(D10_GPIO_Port, D10_Pin, value);   break;
-				case DISPLAY_PIN_RS: HAL_GPIO_WritePin(D11_GPIO_Port, D11_Pin, value);   break;
-				case DISPLAY_PIN_EN: HAL_GPIO_WritePin(D12_GPIO_Port, D12_Pin, value);   break;
-				case DISPLAY_PIN_RW: break;
-				default: break;
-			}
-			break;
-		case DISPLAY_CONNECTION_I2C_PCF8574_IO_EXPANDER:
-			if (value) {
-				switch(pin_name) {
-					case DISPLAY_PIN_D4: pcf8574.display_pin_d4 = ON; break;
-					case DISPLAY_PIN_D5: pcf8574.display_pin_d5 = ON; break;
-					case DISPLAY_PIN_D6: pcf8574.display_pin_d6 = ON; break;
-					case DISPLAY_PIN_D7: pcf8574.display_pin_d7 = ON; break;
-					case DISPLAY_PIN_RS: pcf8574.display_pin_rs = ON; break;
-					case DISPLAY_PIN_EN: pcf8574.display_pin_en = ON; break;
-					case DISPLAY_PIN_RW: pcf8574.display_pin_rw = ON; break;
-					case DISPLAY_PIN_A_PCF8574: pcf8574.display_pin_a = ON; break;
-					default: break;
-	            }
-			}
-	        else {
-	        	switch(pin_name) {
-					case DISPLAY_PIN_D4: pcf8574.display_pin_d4 = OFF; break;
-					case DISPLAY_PIN_D5: pcf8574.display_pin_d5 = OFF; break;
-					case DISPLAY_PIN_D6: pcf8574.display_pin_d6 = OFF; break;
-					case DISPLAY_PIN_D7: pcf8574.display_pin_d7 = OFF; break;
-					case DISPLAY_PIN_RS: pcf8574.display_pin_rs = OFF; break;
-					case DISPLAY_PIN_EN: pcf8574.display_pin_en = OFF; break;
-					case DISPLAY_PIN_RW: pcf8574.display_pin_rw = OFF; break;
-					case DISPLAY_PIN_A_PCF8574: pcf8574.display_pin_a = OFF; break;
-					default: break;
-	            }
-	        }
-			pcf8574.data = 0b00000000;
-			if (pcf8574.display_pin_rs) pcf8574.data |= 0b00000001;
-			if (pcf8574.display_pin_rw) pcf8574.data |= 0b00000010;
-			if (pcf8574.display_pin_en) pcf8574.data |= 0b00000100;
-			if (pcf8574.display_pin_a ) pcf8574.data |= 0b00001000;
-			if (pcf8574.display_pin_d4) pcf8574.data |= 0b00010000;
-			if (pcf8574.display_pin_d5) pcf8574.data |= 0b00100000;
-			if (pcf8574.display_pin_d6) pcf8574.data |= 0b01000000;
-			if (pcf8574.display_pin_d7) pcf8574.data |= 0b10000000;
-			//i2cPcf8574.write(pcf8574.address, &pcf8574.data, 1);
-            HAL_I2C_Master_Transmit(&hi2c1, (uint16_t)pcf8574.address, &pcf8574.data, 16, HAL_MAX_DELAY);
-			break;
-	}
-}
-
-static void display_data_bus_write(uint8_t data_bus)
-{
-    display_pin_write(DISPLAY_PIN_EN, OFF);
-    display_pin_write(DISPLAY_PIN_D7, data_bus & 0b10000000);
-    display_pin_write(DISPLAY_PIN_D6, data_bus & 0b01000000);
-    display_pin_write(DISPLAY_PIN_D5, data_bus & 0b00100000);
-    display_pin_write(DISPLAY_PIN_D4, data_bus & 0b00010000);
-
-	switch (display.connection) {
-		case DISPLAY_CONNECTION_GPIO_8_BITS:
-			display_pin_write(DISPLAY_PIN_D3, data_bus & 0b00001000);
-			display_pin_write(DISPLAY_PIN_D2, data_bus & 0b00000100);
-			display_pin_write(DISPLAY_PIN_D1, data_bus & 0b00000010);
-			display_pin_write(DISPLAY_PIN_D0, data_bus & 0b00000001);
-			break;
-		case DISPLAY_CONNECTION_GPIO_4_BITS:
-        case DISPLAY_CONNECTION_I2C_PCF8574_IO_EXPANDER:
-            if (initial_8_bit_communication_is_completed == true) {
-            	display_pin_write(DISPLAY_PIN_EN, ON);
-            	HAL_Delay(1);
-                display_pin_write(DISPLAY_PIN_EN, OFF);
-                HAL_Delay(1);
-                display_pin_write(DISPLAY_PIN_D7, data_bus & 0b00001000);
-                display_pin_write(DISPLAY_PIN_D6, data_bus & 0b00000100);
-                display_pin_write(DISPLAY_PIN_D5, data_bus & 0b00000010);
-                display_pin_write(DISPLAY_PIN_D4, data_bus & 0b00000001);
+        display_wait(p_display, DISPLAY_TIMING_INSTRUCTION);
+}
+
+static void display_wait(display_t *p_display, display_timing_t timing)
+{
+    display_backend_wait_us(p_display->id, display_timing_us[timing]);
+}
+
+static void display_shadow_clear(display_t *p_display)
+{
+    uint8_t controller;
+
+    memset(p_display->ddram_shadow, DISPLAY_BLANK_CHARACTER, sizeof(p_display->ddram_shadow));
+
+    /* Address 0 is the first cell of each controller ring */
+    for (controller = 0; controller < DISPLAY_CONTROLLERS; controller++)
+        p_display->address_counter[controller] = controller * DISPLAY_CONTROLLER_CELLS;
+}
+
+static bool display_init_step_is_due(display_t *p_display)
+{
+    /* Waits count from the last byte on the bus */
+    if (display_backend_is_busy(p_display->id)) {
+        p_display->init_wait_start = cycle_counter_get();
+        return false;
+    }
+
+    return (cycle_counter_get() - p_display->init_wait_start) >= display_timing_us[p_display->init_wait] * cycles_per_us;
+}
+
+static void display_init_step(display_t *p_display)
+{
+    p_display->init_wait = DISPLAY_TIMING_INSTRUCTION;
+
+    switch (p_display->init_state) {
+        case ST_DISPLAY_INIT_FUNCTION_SET_1:
+            /* Every controller goes through the same sequence at once */
+            display_controller_select(p_display, DISPLAY_CONTROLLER_ALL);
+            display_backend_code_send(p_display->id, DISPLAY_RS_INSTRUCTION, DISPLAY_IR_FUNCTION_SET | DISPLAY_IR_FUNCTION_SET_8BITS);
+            p_display->init_wait = DISPLAY_TIMING_FUNCTION_SET_FIRST;
+            p_display->init_state = ST_DISPLAY_INIT_FUNCTION_SET_2;
+            break;
+
+        case ST_DISPLAY_INIT_FUNCTION_SET_2:
+            display_backend_code_send(p_display->id, DISPLAY_RS_INSTRUCTION, DISPLAY_IR_FUNCTION_SET | DISPLAY_IR_FUNCTION_SET_8BITS);
+            p_display->init_wait = DISPLAY_TIMING_FUNCTION_SET_RETRY;
+            p_display->init_state = ST_DISPLAY_INIT_FUNCTION_SET_3;
+            break;
+
+        case ST_DISPLAY_INIT_FUNCTION_SET_3:
+            display_backend_code_send(p_display->id, DISPLAY_RS_INSTRUCTION, DISPLAY_IR_FUNCTION_SET | DISPLAY_IR_FUNCTION_SET_8BITS);
+            p_display->init_state = ST_DISPLAY_INIT_INTERFACE;
+            break;
+
+        case ST_DISPLAY_INIT_INTERFACE:
+#if (DISPLAY_BACKEND != DISPLAY_BACKEND_GPIO_8_BITS)
+            display_backend_code_send(p_display->id, DISPLAY_RS_INSTRUCTION, DISPLAY_IR_FUNCTION_SET | DISPLAY_IR_FUNCTION_SET_4BITS);
+            display_backend_4_bits_mode_enter(p_display->id);
+#endif
+            p_display->init_state = ST_DISPLAY_INIT_FUNCTION_SET_LINES;
+            break;
+
+        case ST_DISPLAY_INIT_FUNCTION_SET_LINES:
+#if (DISPLAY_BACKEND == DISPLAY_BACKEND_GPIO_8_BITS)
+            display_backend_code_send(p_display->id, DISPLAY_RS_INSTRUCTION, DISPLAY_IR_FUNCTION_SET | DISPLAY_IR_FUNCTION_SET_8BITS | DISPLAY_IR_FUNCTION_SET_2LINES | DISPLAY_IR_FUNCTION_SET_5x8DOTS);
+#else
+            display_backend_code_send(p_display->id, DISPLAY_RS_INSTRUCTION, DISPLAY_IR_FUNCTION_SET | DISPLAY_IR_FUNCTION_SET_4BITS | DISPLAY_IR_FUNCTION_SET_2LINES | DISPLAY_IR_FUNCTION_SET_5x8DOTS);
+#endif
+            p_display->init_state = ST_DISPLAY_INIT_DISPLAY_OFF;
+            break;
+
+        case ST_DISPLAY_INIT_DISPLAY_OFF:
+            display_backend_code_send(p_display->id, DISPLAY_RS_INSTRUCTION, DISPLAY_IR_DISPLAY_CONTROL | DISPLAY_IR_DISPLAY_CONTROL_DISPLAY_OFF | DISPLAY_IR_DISPLAY_CONTROL_CURSOR_OFF | DISPLAY_IR_DISPLAY_CONTROL_BLINK_OFF);
+            p_display->init_state = ST_DISPLAY_INIT_CLEAR;
+            break;
+
+        case ST_DISPLAY_INIT_CLEAR:
+            display_backend_code_send(p_display->id, DISPLAY_RS_INSTRUCTION, DISPLAY_IR_CLEAR_DISPLAY);
+            display_shadow_clear(p_display);
+            p_display->init_wait = DISPLAY_TIMING_CLEAR_HOME;
+            p_display->init_state = ST_DISPLAY_INIT_ENTRY_MODE;
+            break;
+
+        case ST_DISPLAY_INIT_ENTRY_MODE:
+            display_backend_code_send(p_display->id, DISPLAY_RS_INSTRUCTION, DISPLAY_IR_ENTRY_MODE_SET | DISPLAY_IR_ENTRY_MODE_SET_INCREMENT | DISPLAY_IR_ENTRY_MODE_SET_NO_SHIFT);
+            p_display->init_state = ST_DISPLAY_INIT_DISPLAY_ON;
+            break;
+
+        case ST_DISPLAY_INIT_DISPLAY_ON:
+            /* The cursor, if any, is turned on by display_control_write() */
+            display_backend_code_send(p_display->id, DISPLAY_RS_INSTRUCTION, DISPLAY_IR_DISPLAY_CONTROL | DISPLAY_IR_DISPLAY_CONTROL_DISPLAY_ON);
+            p_display->init_state = ST_DISPLAY_READY;
+            break;
+
+        default:
+            break;
+    }
+
+    display_backend_flush(p_display->id);
+    p_display->init_wait_start = cycle_counter_get();
+}
+
+static uint8_t display_cell_index(uint8_t char_position_x, uint8_t char_position_y)
+{
+    uint8_t ring;
+
+    if (char_position_x >= DISPLAY_COLUMNS || char_position_y >= DISPLAY_ROWS)
+        return DISPLAY_ADDRESS_COUNTER_UNKNOWN;
+
+    for (ring = 0; display_geometry.ring_row[ring] != char_position_y; ring++) {
+    }
+    return ring * DISPLAY_COLUMNS + char_position_x;
+}
+
+static uint8_t display_cell_from_address(uint8_t controller, uint8_t address)
+{
+    uint8_t ring, row;
+
+    for (ring = controller * DISPLAY_CONTROLLER_ROWS; ring < (controller + 1) * DISPLAY_CONTROLLER_ROWS; ring++) {
+        row = display_geometry.ring_row[ring];
+        if (address >= display_geometry.row_address[row] && address < display_geometry.row_address[row] + DISPLAY_COLUMNS)
+            return ring * DISPLAY_COLUMNS + address - display_geometry.row_address[row];
+    }
+
+    return DISPLAY_ADDRESS_COUNTER_UNKNOWN;
+}
+
+/* Cell the address counter moves to after a data write at cell */
+static uint8_t display_cell_next(uint8_t cell)
+{
+    uint8_t first = cell - cell % DISPLAY_CONTROLLER_CELLS;
+
+    /* Past the end of a row the counter walks unseen addresses */
+    if (display_geometry.ring_is_visible == false && (cell + 1) % DISPLAY_COLUMNS == 0)
+        return DISPLAY_ADDRESS_COUNTER_UNKNOWN;
+
+    return first + (cell + 1 - first) % DISPLAY_CONTROLLER_CELLS;
+}
+
+/* Data writes that take the address counter from one cell to the other,
+ * more than any frame when it cannot get there by auto-increment */
+static uint8_t display_cell_gap(uint8_t from, uint8_t to)
+{
+    if (from == DISPLAY_ADDRESS_COUNTER_UNKNOWN)
+        return DISPLAY_CELLS;
+
+    if (display_geometry.ring_is_visible)
+        return (to + DISPLAY_CONTROLLER_CELLS - from) % DISPLAY_CONTROLLER_CELLS;
+
+    if (to >= from && to / DISPLAY_COLUMNS == from / DISPLAY_COLUMNS)
+        return to - from;
+    return DISPLAY_CELLS;
+}
+
+static void display_controller_select(display_t *p_display, uint8_t controller)
+{
+    if (DISPLAY_CONTROLLERS == 1 || p_display->controller == controller)
+        return;
+
+    p_display->controller = controller;
+    display_backend_controller_select(p_display->id, (controller == DISPLAY_CONTROLLER_ALL) ? ((1 << DISPLAY_CONTROLLERS) - 1) : (1 << controller));
+}
+
+/* Only the controller holding the cursor cell shows the cursor */
+static void display_control_write(display_t *p_display)
+{
+    uint8_t controller, control;
+
+    for (controller = 0; controller < DISPLAY_CONTROLLERS; controller++) {
+        control = p_display->control;
+        if (p_display->cursor_cell == DISPLAY_ADDRESS_COUNTER_UNKNOWN || p_display->cursor_cell / DISPLAY_CONTROLLER_CELLS != controller)
+            control &= ~(DISPLAY_IR_DISPLAY_CONTROL_CURSOR_ON | DISPLAY_IR_DISPLAY_CONTROL_BLINK_ON);
+
+        display_controller_select(p_display, controller);
+        display_code_write(p_display, DISPLAY_RS_INSTRUCTION, DISPLAY_IR_DISPLAY_CONTROL | control);
+    }
+}
+
+static uint8_t display_address_instruction(uint8_t cell)
+{
+    uint8_t row = display_geometry.ring_row[cell / DISPLAY_COLUMNS];
+    uint8_t column = cell % DISPLAY_COLUMNS;
+
+    return DISPLAY_IR_SET_DDRAM_ADDR | (display_geometry.row_address[row] + column);
+}
+
+static void display_address_counter_write(display_t *p_display, uint8_t cell)
+{
+    uint8_t controller = cell / DISPLAY_CONTROLLER_CELLS;
+
+    display_controller_select(p_display, controller);
+    display_code_write(p_display, DISPLAY_RS_INSTRUCTION, display_address_instruction(cell));
+    p_display->address_counter[controller] = cell;
+}
+
+static void display_data_write(display_t *p_display, char character)
+{
+    uint8_t *p_address_counter = &p_display->address_counter[(p_display->controller == DISPLAY_CONTROLLER_ALL) ? 0 : p_display->controller];
+
+    display_code_write(p_display, DISPLAY_RS_DATA, character);
+
+    if (*p_address_counter != DISPLAY_ADDRESS_COUNTER_UNKNOWN) {
+        p_display->ddram_shadow[*p_address_counter] = character;
+        p_display->frame[*p_address_counter] = character;
+        *p_address_counter = display_cell_next(*p_address_counter);
+    }
+}
+static void display_glyph_upload(display_t *p_display, uint8_t slot)
+{
+    uint8_t row, controller;
+
+    /* Each controller has its own CGRAM */
+    display_controller_select(p_display, DISPLAY_CONTROLLER_ALL);
+    display_code_write(p_display, DISPLAY_RS_INSTRUCTION, DISPLAY_IR_SET_CGRAM_ADDR | (slot * DISPLAY_GLYPH_ROWS));
+    for (row = 0; row < DISPLAY_GLYPH_ROWS; row++)
+        display_code_write(p_display, DISPLAY_RS_DATA, p_display->glyph_slot[slot].glyph.rows[row]);
+
+    /* The address counters now point into CGRAM */
+    for (controller = 0; controller < DISPLAY_CONTROLLERS; controller++)
+        p_display->address_counter[controller] = DISPLAY_ADDRESS_COUNTER_UNKNOWN;
+    p_display->glyph_slot[slot].uploaded = true;
+}
+
+static void display_cursor_restore(display_t *p_display)
+{
+    if (p_display->cursor_cell != DISPLAY_ADDRESS_COUNTER_UNKNOWN &&
+        p_display->address_counter[p_display->cursor_cell / DISPLAY_CONTROLLER_CELLS] != p_display->cursor_cell)
+        display_address_counter_write(p_display, p_display->cursor_cell);
+}
+
+/* Spends what the backend will actually put on the bus for the code, RS
+ * settle bytes and redrawn pixels included */
+static bool display_budget_spend(display_t *p_display, uint32_t *p_budget, bool type, uint8_t data_bus)
+{
+    uint32_t cost = display_backend_code_cost(p_display->id, type, data_bus);
+
+    if (*p_budget < cost)
+        return false;
+    *p_budget -= cost;
+    return true;
+}
+
+/* Each address command and each character spends its bus cost from the
+ * budget, right before it is written. Returns false when the budget ran
+ * out before the controller was clean, the dirty cells left are picked up
+ * by the next call. */
+static bool display_frame_controller_flush(display_t *p_display, uint8_t controller, uint32_t *p_budget)
+{
+    uint8_t *p_address_counter = &p_display->address_counter[controller];
+    uint8_t first = controller * DISPLAY_CONTROLLER_CELLS;
+    uint8_t start, cell, i, gap;
+
+    /* The tracked counter is used as is. Reading it back would block on
+     * the bus, and after a glyph upload the controller counter points
+     * into CGRAM, where it must not be taken for a cell. */
+    display_controller_select(p_display, controller);
+
+    /* Walk the cells in address counter order, starting where the counter
+     * already is, so that auto-increment carries from one run to the next
+     * and across rows */
+    start = (*p_address_counter == DISPLAY_ADDRESS_COUNTER_UNKNOWN) ? 0 : *p_address_counter - first;
+
+    for (i = 0; i < DISPLAY_CONTROLLER_CELLS; i++) {
+        cell = first + (start + i) % DISPLAY_CONTROLLER_CELLS;
+        if (p_display->frame[cell] == p_display->ddram_shadow[cell])
+            continue;
+
+        if (*p_address_counter != cell) {
+            gap = display_cell_gap(*p_address_counter, cell);
+
+            /* Re-sending a short gap of clean cells is cheaper than moving
+             * the address counter over it */
+            if (gap * DISPLAY_BACKEND_DATA_COST <= DISPLAY_BACKEND_ADDRESS_COST) {
+                while (*p_address_counter != cell) {
+                    if (display_budget_spend(p_display, p_budget, DISPLAY_RS_DATA, p_display->frame[*p_address_counter]) == false)
+                        return false;
+                    display_data_write(p_display, p_display->frame[*p_address_counter]);
+                }
+            }
+            else {
+                if (display_budget_spend(p_display, p_budget, DISPLAY_RS_INSTRUCTION, display_address_instruction(cell)) == false)
+                    return false;
+                display_address_counter_write(p_display, cell);
             }
-			break;
-	}
+        }
+
+        if (display_budget_spend(p_display, p_budget, DISPLAY_RS_DATA, p_display->frame[cell]) == false)
+            return false;
+        display_data_write(p_display, p_display->frame[cell]);
+    }
+    return true;
+}
+
+static void display_instance_update(display_t *p_display)
+{
+    uint8_t slot;
+
+    /* While the transport is down, writes only reach the frame, and the
+     * latest one is shown once the controller is brought up again */
+    if (display_backend_is_healthy() == false) {
+        if (p_display->init_state != ST_DISPLAY_OFFLINE) {
+            p_display->init_state = ST_DISPLAY_OFFLINE;
+            for (slot = 0; slot < DISPLAY_GLYPH_SLOTS; slot++)
+                p_display->glyph_slot[slot].uploaded = false;
+        }
+        return;
+    }
 
-    display_pin_write(DISPLAY_PIN_EN, ON);
-    HAL_Delay(1);
-    display_pin_write(DISPLAY_PIN_EN, OFF);
-    HAL_Delay(1);
+    if (p_display->init_state == ST_DISPLAY_OFFLINE) {
+        p_display->init_state = ST_DISPLAY_INIT_FUNCTION_SET_1;
+        p_display->init_wait = DISPLAY_TIMING_FUNCTION_SET_FIRST;
+        p_display->init_wait_start = cycle_counter_get();
+    }
+
+    while (p_display->init_state != ST_DISPLAY_READY && display_init_step_is_due(p_display)) {
+        display_init_step(p_display);
+
+        /* Send whatever was rendered while the controller was powering up */
+        if (p_display->init_state == ST_DISPLAY_READY) {
+            if (p_display->cursor_cell != DISPLAY_ADDRESS_COUNTER_UNKNOWN)
+                display_control_write(p_display);
+            for (slot = 0; slot < DISPLAY_GLYPH_SLOTS; slot++)
+                if (p_display->glyph_slot[slot].assigned && !p_display->glyph_slot[slot].uploaded)
+                    display_glyph_upload(p_display, slot);
+            display_frame_flush(p_display);
+        }
+    }
 }
 
 /********************** external functions definition ************************/
-void display_init(display_connection_t connection)
+void display_delay_us(uint32_t delay_us)
 {
-    display.connection = connection;
+    uint32_t start = cycle_counter_get();
+    uint32_t cycles = delay_us * cycles_per_us;
 
-    if (display.connection == DISPLAY_CONNECTION_I2C_PCF8574_IO_EXPANDER) {
-    	pcf8574.address = PCF8574_I2C_BUS_8BIT_WRITE_ADDRESS;
-        pcf8574.data = 0b00000000;
-        //i2cPcf8574.frequency(100000);
-        display_pin_write(DISPLAY_PIN_A_PCF8574, ON);
+    while ((cycle_counter_get() - start) < cycles) {
     }
+}
 
-    initial_8_bit_communication_is_completed = false;
-	HAL_Delay(50);
-
-    display_code_write(DISPLAY_RS_INSTRUCTION, DISPLAY_IR_FUNCTION_SET | DISPLAY_IR_FUNCTION_SET_8BITS);
-    HAL_Delay(5);
-    display_code_write(DISPLAY_RS_INSTRUCTION, DISPLAY_IR_FUNCTION_SET | DISPLAY_IR_FUNCTION_SET_8BITS);
-    HAL_Delay(1);
-    display_code_write(DISPLAY_RS_INSTRUCTION, DISPLAY_IR_FUNCTION_SET | DISPLAY_IR_FUNCTION_SET_8BITS);
-    HAL_Delay(1);
-
-    switch (display.connection) {
-    	case DISPLAY_CONNECTION_GPIO_8_BITS:
-    		display_code_write(DISPLAY_RS_INSTRUCTION, DISPLAY_IR_FUNCTION_SET | DISPLAY_IR_FUNCTION_SET_8BITS | DISPLAY_IR_FUNCTION_SET_2LINES | DISPLAY_IR_FUNCTION_SET_5x8DOTS);
-    		HAL_Delay(1);
-    		break;
-        case DISPLAY_CONNECTION_GPIO_4_BITS:
-        case DISPLAY_CONNECTION_I2C_PCF8574_IO_EXPANDER:
-        	display_code_write(DISPLAY_RS_INSTRUCTION, DISPLAY_IR_FUNCTION_SET | DISPLAY_IR_FUNCTION_SET_4BITS);
-        	HAL_Delay(1);
-        	initial_8_bit_communication_is_completed = true;
-        	display_code_write(DISPLAY_RS_INSTRUCTION, DISPLAY_IR_FUNCTION_SET | DISPLAY_IR_FUNCTION_SET_4BITS | DISPLAY_IR_FUNCTION_SET_2LINES | DISPLAY_IR_FUNCTION_SET_5x8DOTS);
-            HAL_Delay(1);
-            break;
+display_t * display_init(uint8_t bus_address)
+{
+    display_t *p_display = NULL;
+    uint8_t id;
+
+    for (id = 0; id < DISPLAY_INSTANCES_MAX && p_display == NULL; id++) {
+        if (display[id].in_use == false)
+            p_display = &display[id];
     }
+    if (p_display == NULL)
+        return NULL;
+
+    memset(p_display, 0, sizeof(display_t));
+    p_display->id = p_display - display;
+    p_display->in_use = true;
+    display_backend_init(p_display->id, bus_address);
+
+    memset(p_display->frame, DISPLAY_BLANK_CHARACTER, sizeof(p_display->frame));
+    p_display->control = DISPLAY_IR_DISPLAY_CONTROL_DISPLAY_ON | DISPLAY_IR_DISPLAY_CONTROL_CURSOR_OFF | DISPLAY_IR_DISPLAY_CONTROL_BLINK_OFF;
+    p_display->cursor_cell = DISPLAY_ADDRESS_COUNTER_UNKNOWN;
+    /* Backends start with the first enable line selected */
+    p_display->controller = 0;
+
+    /* The controller is brought up by display_update(), one step at a time */
+    p_display->init_state = ST_DISPLAY_INIT_FUNCTION_SET_1;
+    p_display->init_wait = DISPLAY_TIMING_POWER_ON;
+    p_display->init_wait_start = cycle_counter_get();
+
+    return p_display;
+}
+
+void display_update(void)
+{
+    uint8_t id;
+
+    display_backend_update();
 
-    display_code_write(DISPLAY_RS_INSTRUCTION, DISPLAY_IR_DISPLAY_CONTROL | DISPLAY_IR_DISPLAY_CONTROL_DISPLAY_OFF | DISPLAY_IR_DISPLAY_CONTROL_CURSOR_OFF | DISPLAY_IR_DISPLAY_CONTROL_BLINK_OFF);
-    HAL_Delay(1);
-    display_code_write(DISPLAY_RS_INSTRUCTION, DISPLAY_IR_CLEAR_DISPLAY);
-    HAL_Delay(1);
-    display_code_write(DISPLAY_RS_INSTRUCTION, DISPLAY_IR_ENTRY_MODE_SET | DISPLAY_IR_ENTRY_MODE_SET_INCREMENT | DISPLAY_IR_ENTRY_MODE_SET_NO_SHIFT);
-    HAL_Delay(1);
-    display_code_write( DISPLAY_RS_INSTRUCTION, DISPLAY_IR_DISPLAY_CONTROL | DISPLAY_IR_DISPLAY_CONTROL_DISPLAY_ON | DISPLAY_IR_DISPLAY_CONTROL_CURSOR_OFF | DISPLAY_IR_DISPLAY_CONTROL_BLINK_OFF);
-    HAL_Delay(1);
-}
-
-void display_char_position_write(uint8_t char_position_x, uint8_t char_position_y)
-{    
-    switch (char_position_y) {
-        case 0: display_code_write(DISPLAY_RS_INSTRUCTION, DISPLAY_IR_SET_DDRAM_ADDR | (DISPLAY_20x4_LINE1_FIRST_CHARACTER_ADDRESS + char_position_x));   break;
-        case 1: display_code_write(DISPLAY_RS_INSTRUCTION, DISPLAY_IR_SET_DDRAM_ADDR | (DISPLAY_20x4_LINE2_FIRST_CHARACTER_ADDRESS + char_position_x));   break;
-        case 2: display_code_write(DISPLAY_RS_INSTRUCTION, DISPLAY_IR_SET_DDRAM_ADDR | (DISPLAY_20x4_LINE3_FIRST_CHARACTER_ADDRESS + char_position_x));   break;
-        case 3: display_code_write(DISPLAY_RS_INSTRUCTION, DISPLAY_IR_SET_DDRAM_ADDR | (DISPLAY_20x4_LINE4_FIRST_CHARACTER_ADDRESS + char_position_x));   break;
+    /* Panels step independently, so one panel's waits are filled with
+     * another panel's bursts */
+    for (id = 0; id < DISPLAY_INSTANCES_MAX; id++) {
+        if (display[id].in_use)
+            display_instance_update(&display[id]);
     }
-    HAL_Delay(1);
 }
 
-void display_string_write(const char * str)
+bool display_is_ready(display_t *p_display)
 {
+    return p_display->init_state == ST_DISPLAY_READY;
+}
+
+void display_char_position_write(display_t *p_display, uint8_t char_position_x, uint8_t char_position_y)
+{
+    uint8_t cell = display_cell_index(char_position_x, char_position_y);
+    uint8_t row = char_position_y % DISPLAY_ROWS;
+
+    if (display_is_ready(p_display) == false) {
+        p_display->write_cell = cell;
+        return;
+    }
+
+    if (cell == DISPLAY_ADDRESS_COUNTER_UNKNOWN) {
+        /* Outside the visible cells, the shadow cannot follow */
+        display_controller_select(p_display, display_geometry.row_controller[row]);
+        display_code_write(p_display, DISPLAY_RS_INSTRUCTION, DISPLAY_IR_SET_DDRAM_ADDR | (display_geometry.row_address[row] + char_position_x));
+        p_display->address_counter[display_geometry.row_controller[row]] = DISPLAY_ADDRESS_COUNTER_UNKNOWN;
+    }
+    else {
+        display_address_counter_write(p_display, cell);
+    }
+    display_backend_flush(p_display->id);
+}
+void display_string_write(display_t *p_display, const char * str)
+{
+    /* Buffered in the frame until the controller is ready */
+    if (display_is_ready(p_display) == false) {
+        while (*str && p_display->write_cell != DISPLAY_ADDRESS_COUNTER_UNKNOWN) {
+            p_display->frame[p_display->write_cell] = *str++;
+            p_display->write_cell = display_cell_next(p_display->write_cell);
+        }
+        return;
+    }
+
     while (*str) {
-        display_code_write(DISPLAY_RS_DATA, *str++);
+        display_data_write(p_display, *str++);
+    }
+    display_backend_flush(p_display->id);
+}
+void display_frame_string_write(display_t *p_display, uint8_t char_position_x, uint8_t char_position_y, const char * str)
+{
+    uint8_t cell = display_cell_index(char_position_x, char_position_y);
+
+    if (cell == DISPLAY_ADDRESS_COUNTER_UNKNOWN)
+        return;
+
+    while (*str && char_position_x++ < DISPLAY_COLUMNS) {
+        p_display->frame[cell++] = *str++;
+    }
+}
+void display_frame_flush(display_t *p_display)
+{
+    display_frame_flush_budget(p_display, DISPLAY_FLUSH_BUDGET_UNLIMITED);
+}
+
+/* Sends at most budget bus cost units of the frame, see the backend costs.
+ * Returns true once the whole frame is on the panel. */
+bool display_frame_flush_budget(display_t *p_display, uint32_t budget)
+{
+    uint8_t controller;
+
+    /* Kept in the frame, display_update() flushes it once ready */
+    if (display_is_ready(p_display) == false)
+        return false;
+
+    /* A smaller budget could be spent moving the address counter and never
+     * reach the character, every call has to write at least one */
+    if (budget < DISPLAY_FLUSH_BUDGET_MIN)
+        budget = DISPLAY_FLUSH_BUDGET_MIN;
+
+    for (controller = 0; controller < DISPLAY_CONTROLLERS; controller++) {
+        if (display_frame_controller_flush(p_display, controller, &budget) == false) {
+            display_backend_flush(p_display->id);
+            return false;
+        }
+    }
+
+    /* Moving the counter back under the cursor comes out of the budget
+     * too, the next call does it when nothing is left */
+    if (p_display->cursor_cell != DISPLAY_ADDRESS_COUNTER_UNKNOWN &&
+        p_display->address_counter[p_display->cursor_cell / DISPLAY_CONTROLLER_CELLS] != p_display->cursor_cell &&
+        display_budget_spend(p_display, &budget, DISPLAY_RS_INSTRUCTION, display_address_instruction(p_display->cursor_cell)) == false) {
+        display_backend_flush(p_display->id);
+        return false;
+    }
+
+    display_cursor_restore(p_display);
+    display_backend_flush(p_display->id);
+    return true;
+}
+
+bool display_address_counter_read(display_t *p_display, uint8_t *p_char_position_x, uint8_t *p_char_position_y)
+{
+    uint8_t address, cell;
+
+    /* An unknown tracked counter may point into CGRAM, whose addresses
+     * would be mistaken for cells */
+    if (display_is_ready(p_display) == false || p_display->controller == DISPLAY_CONTROLLER_ALL ||
+        p_display->address_counter[p_display->controller] == DISPLAY_ADDRESS_COUNTER_UNKNOWN ||
+        display_backend_address_counter_read(p_display->id, &address) == false)
+        return false;
+
+    cell = display_cell_from_address(p_display->controller, address);
+    if (cell == DISPLAY_ADDRESS_COUNTER_UNKNOWN)
+        return false;
+
+    *p_char_position_x = cell % DISPLAY_COLUMNS;
+    *p_char_position_y = display_geometry.ring_row[cell / DISPLAY_COLUMNS];
+    return true;
+}
+
+void display_cursor_show(display_t *p_display, uint8_t char_position_x, uint8_t char_position_y, bool blink)
+{
+    uint8_t control = DISPLAY_IR_DISPLAY_CONTROL_DISPLAY_ON | DISPLAY_IR_DISPLAY_CONTROL_CURSOR_ON |
+                      (blink ? DISPLAY_IR_DISPLAY_CONTROL_BLINK_ON : DISPLAY_IR_DISPLAY_CONTROL_BLINK_OFF);
+
+    p_display->cursor_cell = display_cell_index(char_position_x, char_position_y);
+
+    /* Applied by the power-up sequence and the first frame flush */
+    if (display_is_ready(p_display) == false) {
+        p_display->control = control;
+        return;
+    }
+
+    if (p_display->control != control || DISPLAY_CONTROLLERS > 1) {
+        p_display->control = control;
+        display_control_write(p_display);
+    }
+    display_cursor_restore(p_display);
+    display_backend_flush(p_display->id);
+}
+
+void display_cursor_hide(display_t *p_display)
+{
+    p_display->cursor_cell = DISPLAY_ADDRESS_COUNTER_UNKNOWN;
+    p_display->control = DISPLAY_IR_DISPLAY_CONTROL_DISPLAY_ON | DISPLAY_IR_DISPLAY_CONTROL_CURSOR_OFF | DISPLAY_IR_DISPLAY_CONTROL_BLINK_OFF;
+
+    if (display_is_ready(p_display) == false)
+        return;
+
+    display_control_write(p_display);
+    display_backend_flush(p_display->id);
+}
+char display_glyph_acquire(display_t *p_display, const display_glyph_t * glyph)
+{
+    uint8_t slot, victim = DISPLAY_GLYPH_SLOTS;
+
+    for (slot = 0; slot < DISPLAY_GLYPH_SLOTS; slot++) {
+        display_glyph_slot_t *p_slot = &p_display->glyph_slot[slot];
+
+        /* Already resident, no upload needed */
+        if (p_slot->assigned && memcmp(&p_slot->glyph, glyph, sizeof(display_glyph_t)) == 0) {
+            p_slot->references++;
+            p_slot->last_use = ++p_display->glyph_use_count;
+            return DISPLAY_GLYPH_FIRST_CHARACTER + slot;
+        }
+
+        /* Prefer a free slot, then the least recently used unreferenced one */
+        if (p_slot->references == 0) {
+            if (victim == DISPLAY_GLYPH_SLOTS ||
+                (p_display->glyph_slot[victim].assigned && (!p_slot->assigned || p_slot->last_use < p_display->glyph_slot[victim].last_use)))
+                victim = slot;
+        }
+    }
+
+    /* Every slot is on screen */
+    if (victim == DISPLAY_GLYPH_SLOTS)
+        return DISPLAY_GLYPH_NONE;
+
+    p_display->glyph_slot[victim].glyph = *glyph;
+    p_display->glyph_slot[victim].references = 1;
+    p_display->glyph_slot[victim].last_use = ++p_display->glyph_use_count;
+    p_display->glyph_slot[victim].assigned = true;
+    p_display->glyph_slot[victim].uploaded = false;
+
+    /* Uploaded by display_update() if the controller is not ready yet */
+    if (display_is_ready(p_display)) {
+        display_glyph_upload(p_display, victim);
+        display_cursor_restore(p_display);
+        display_backend_flush(p_display->id);
     }
+
+    return DISPLAY_GLYPH_FIRST_CHARACTER + victim;
+}
+
+void display_glyph_release(display_t *p_display, char character)
+{
+    uint8_t slot = (uint8_t)character - DISPLAY_GLYPH_FIRST_CHARACTER;
+
+    if (slot < DISPLAY_GLYPH_SLOTS && p_display->glyph_slot[slot].references > 0)
+        p_display->glyph_slot[slot].references--;
 }
 
 void keep_alive()
 {
-	display_pin_write(DISPLAY_PIN_A_PCF8574, ON);
+    uint8_t id;
+
+    if (DISPLAY_STATE_REFRESH_INTERVAL_MS == 0 || (HAL_GetTick() - display_refresh_tick) < DISPLAY_STATE_REFRESH_INTERVAL_MS)
+        return;
+
+    display_refresh_tick = HAL_GetTick();
+    for (id = 0; id < DISPLAY_INSTANCES_MAX; id++) {
+        if (display[id].in_use && display_is_ready(&display[id]))
+            display_backend_refresh(id);
+    }
 }
 
 /********************** end of file ******************************************/
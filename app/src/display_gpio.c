@@ -0,0 +1,307 @@
+/*
+ * Copyright (c) 2023 Juan Manuel Cruz <jcruz@fi.uba.ar> <jcruz@frba.utn.edu.ar>.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ * @file   : display_gpio.c
+ * @date   : Ago 14, 2024
+ * @author : Manuel Collazo <mcollazo@fi.uba.ar>
+ * @version	v1.0.0
+ */
+
+/********************** inclusions *******************************************/
+#include <stdbool.h>
+#include <string.h>
+
+/* Project includes. */
+#include "main.h"
+
+/* Application & Tasks includes. */
+#include "display.h"
+#include "display_backend.h"
+
+#if ((DISPLAY_BACKEND == DISPLAY_BACKEND_GPIO_4_BITS) || (DISPLAY_BACKEND == DISPLAY_BACKEND_GPIO_8_BITS))
+
+/********************** macros and definitions *******************************/
+#if (DISPLAY_BACKEND == DISPLAY_BACKEND_GPIO_8_BITS)
+#define DISPLAY_GPIO_BUS_LINES 8
+#else
+#define DISPLAY_GPIO_BUS_LINES 4
+#endif
+
+#define DISPLAY_GPIO_NIBBLE_VALUES 16
+#define DISPLAY_GPIO_PORTS_MAX      3
+
+/* BSRR takes the pins to set in the low half and the pins to reset in the
+ * high half */
+#define DISPLAY_GPIO_BSRR_SET(pin)   ((uint32_t)(pin))
+#define DISPLAY_GPIO_BSRR_RESET(pin) ((uint32_t)(pin) << 16)
+
+#define DISPLAY_EN_PULSE_US 1
+
+/* Enable line of the second controller of a 40x4 panel, D3 on the Arduino
+ * header (SWO is free, the debug port is set up as SWD only) */
+#ifndef DISPLAY_GPIO_EN2_PORT
+#define DISPLAY_GPIO_EN2_PORT SWO_GPIO_Port
+#endif
+#ifndef DISPLAY_GPIO_EN2_PIN
+#define DISPLAY_GPIO_EN2_PIN  SWO_Pin
+#endif
+
+typedef struct {
+    GPIO_TypeDef *port;
+    uint16_t pin;
+} display_gpio_pin_t;
+
+/* Everything one data bus write stores into one port. The high nibble
+ * table drives DB4..DB7, the low nibble table DB0..DB3 in 8 bits mode. */
+typedef struct {
+    GPIO_TypeDef *port;
+    uint32_t bsrr_rs[2];
+    uint32_t bsrr_high_nibble[DISPLAY_GPIO_NIBBLE_VALUES];
+#if (DISPLAY_BACKEND == DISPLAY_BACKEND_GPIO_8_BITS)
+    uint32_t bsrr_low_nibble[DISPLAY_GPIO_NIBBLE_VALUES];
+#endif
+} display_gpio_port_t;
+
+/********************** internal data declaration ****************************/
+static bool initial_8_bit_communication_is_completed;
+static uint8_t display_gpio_enables;
+
+static display_gpio_port_t display_gpio_port[DISPLAY_GPIO_PORTS_MAX];
+static uint8_t display_gpio_ports;
+
+/********************** internal functions declaration ***********************/
+static display_gpio_port_t * display_gpio_port_get(GPIO_TypeDef *port);
+static void display_gpio_nibble_masks_build(const display_gpio_pin_t *p_line, bool low_nibble);
+static void display_data_bus_write(uint8_t data_bus, bool type);
+static void display_en_pulse(void);
+
+/********************** internal data definition *****************************/
+/* Controller data lines, DB0 first (4 bits mode only wires DB4..DB7) */
+static const display_gpio_pin_t display_gpio_bus[DISPLAY_GPIO_BUS_LINES] = {
+#if (DISPLAY_BACKEND == DISPLAY_BACKEND_GPIO_8_BITS)
+    {D2_GPIO_Port,  D2_Pin},
+    {D4_GPIO_Port,  D4_Pin},
+    {D5_GPIO_Port,  D5_Pin},
+    {D6_GPIO_Port,  D6_Pin},
+#endif
+    {D7_GPIO_Port,  D7_Pin},
+    {D8_GPIO_Port,  D8_Pin},
+    {D9_GPIO_Port,  D9_Pin},
+    {D10_GPIO_Port, D10_Pin},
+};
+
+static const display_gpio_pin_t display_gpio_rs = {D11_GPIO_Port, D11_Pin};
+static const display_gpio_pin_t display_gpio_en[DISPLAY_CONTROLLERS] = {
+    {D12_GPIO_Port, D12_Pin},
+#if (DISPLAY_CONTROLLERS > 1)
+    {DISPLAY_GPIO_EN2_PORT, DISPLAY_GPIO_EN2_PIN},
+#endif
+};
+
+/********************** external data declaration ****************************/
+
+/********************** internal functions definition ************************/
+static display_gpio_port_t * display_gpio_port_get(GPIO_TypeDef *port)
+{
+    uint8_t i;
+
+    for (i = 0; i < display_gpio_ports; i++) {
+        if (display_gpio_port[i].port == port)
+            return &display_gpio_port[i];
+    }
+
+    display_gpio_port[display_gpio_ports].port = port;
+    return &display_gpio_port[display_gpio_ports++];
+}
+
+static void display_gpio_nibble_masks_build(const display_gpio_pin_t *p_line, bool low_nibble)
+{
+    uint8_t nibble, bit;
+
+    for (nibble = 0; nibble < DISPLAY_GPIO_NIBBLE_VALUES; nibble++) {
+        for (bit = 0; bit < 4; bit++) {
+            display_gpio_port_t *p_port = display_gpio_port_get(p_line[bit].port);
+#if (DISPLAY_BACKEND == DISPLAY_BACKEND_GPIO_8_BITS)
+            uint32_t *p_word = low_nibble ? p_port->bsrr_low_nibble : p_port->bsrr_high_nibble;
+#else
+            uint32_t *p_word = p_port->bsrr_high_nibble;
+#endif
+
+            if (nibble & (1 << bit))
+                p_word[nibble] |= DISPLAY_GPIO_BSRR_SET(p_line[bit].pin);
+            else
+                p_word[nibble] |= DISPLAY_GPIO_BSRR_RESET(p_line[bit].pin);
+        }
+    }
+}
+
+static void display_data_bus_write(uint8_t data_bus, bool type)
+{
+    uint8_t i;
+
+    /* One store per port sets RS and the whole bus, EN is already low */
+    for (i = 0; i < display_gpio_ports; i++) {
+        display_gpio_port_t *p_port = &display_gpio_port[i];
+#if (DISPLAY_BACKEND == DISPLAY_BACKEND_GPIO_8_BITS)
+        p_port->port->BSRR = p_port->bsrr_rs[type] | p_port->bsrr_high_nibble[data_bus >> 4] | p_port->bsrr_low_nibble[data_bus & 0x0F];
+#else
+        p_port->port->BSRR = p_port->bsrr_rs[type] | p_port->bsrr_high_nibble[data_bus >> 4];
+#endif
+    }
+    display_en_pulse();
+
+#if (DISPLAY_BACKEND == DISPLAY_BACKEND_GPIO_4_BITS)
+    if (initial_8_bit_communication_is_completed == true) {
+        display_delay_us(DISPLAY_EN_PULSE_US);
+        for (i = 0; i < display_gpio_ports; i++) {
+            display_gpio_port_t *p_port = &display_gpio_port[i];
+            p_port->port->BSRR = p_port->bsrr_high_nibble[data_bus & 0x0F];
+        }
+        display_en_pulse();
+    }
+#endif
+}
+
+static void display_en_pulse(void)
+{
+    uint8_t i;
+
+    for (i = 0; i < DISPLAY_CONTROLLERS; i++) {
+        if (display_gpio_enables & (1 << i))
+            display_gpio_en[i].port->BSRR = DISPLAY_GPIO_BSRR_SET(display_gpio_en[i].pin);
+    }
+    display_delay_us(DISPLAY_EN_PULSE_US);
+    for (i = 0; i < DISPLAY_CONTROLLERS; i++)
+        display_gpio_en[i].port->BSRR = DISPLAY_GPIO_BSRR_RESET(display_gpio_en[i].pin);
+}
+
+/********************** external functions definition ************************/
+void display_backend_init(uint8_t id, uint8_t bus_address)
+{
+    display_gpio_port_t *p_port;
+
+    initial_8_bit_communication_is_completed = false;
+
+    /* Split the pin mapping into per port set/reset words, once */
+    memset(display_gpio_port, 0, sizeof(display_gpio_port));
+    display_gpio_ports = 0;
+
+    p_port = display_gpio_port_get(display_gpio_rs.port);
+    p_port->bsrr_rs[DISPLAY_RS_INSTRUCTION] = DISPLAY_GPIO_BSRR_RESET(display_gpio_rs.pin);
+    p_port->bsrr_rs[DISPLAY_RS_DATA] = DISPLAY_GPIO_BSRR_SET(display_gpio_rs.pin);
+
+#if (DISPLAY_BACKEND == DISPLAY_BACKEND_GPIO_8_BITS)
+    display_gpio_nibble_masks_build(&display_gpio_bus[0], true);
+    display_gpio_nibble_masks_build(&display_gpio_bus[4], false);
+#else
+    display_gpio_nibble_masks_build(&display_gpio_bus[0], false);
+#endif
+
+    display_gpio_enables = 1;
+    display_gpio_en[0].port->BSRR = DISPLAY_GPIO_BSRR_RESET(display_gpio_en[0].pin);
+
+#if (DISPLAY_CONTROLLERS > 1)
+    /* Not set up by CubeMX, the first enable line is */
+    GPIO_InitTypeDef GPIO_InitStruct = {0};
+
+    GPIO_InitStruct.Pin = DISPLAY_GPIO_EN2_PIN;
+    GPIO_InitStruct.Mode = GPIO_MODE_OUTPUT_PP;
+    GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_LOW;
+    HAL_GPIO_WritePin(DISPLAY_GPIO_EN2_PORT, DISPLAY_GPIO_EN2_PIN, GPIO_PIN_RESET);
+    HAL_GPIO_Init(DISPLAY_GPIO_EN2_PORT, &GPIO_InitStruct);
+#endif
+}
+
+void display_backend_update(void)
+{
+}
+
+bool display_backend_is_healthy(void)
+{
+    return true;
+}
+
+void display_backend_controller_select(uint8_t id, uint8_t controllers)
+{
+    display_gpio_enables = controllers;
+}
+
+void display_backend_4_bits_mode_enter(uint8_t id)
+{
+    initial_8_bit_communication_is_completed = true;
+}
+
+void display_backend_code_send(uint8_t id, bool type, uint8_t data_bus)
+{
+    /* RW is tied low on the GPIO connector */
+    display_data_bus_write(data_bus, type);
+}
+
+uint32_t display_backend_code_cost(uint8_t id, bool type, uint8_t data_bus)
+{
+    return (type == DISPLAY_RS_DATA) ? DISPLAY_GPIO_DATA_COST : DISPLAY_GPIO_ADDRESS_COST;
+}
+
+void display_backend_wait_us(uint8_t id, uint32_t wait_us)
+{
+    display_delay_us(wait_us);
+}
+
+void display_backend_flush(uint8_t id)
+{
+    /* Every pin change is already on the bus */
+}
+
+bool display_backend_is_busy(uint8_t id)
+{
+    return false;
+}
+
+bool display_backend_address_counter_read(uint8_t id, uint8_t *p_address)
+{
+    /* RW is tied low on the GPIO connector */
+    return false;
+}
+
+void display_backend_backlight_write(uint8_t id, bool on)
+{
+    /* The backlight is not wired to the GPIO connector */
+}
+
+void display_backend_refresh(uint8_t id)
+{
+    /* GPIO outputs hold their state */
+}
+
+#endif /* DISPLAY_BACKEND == DISPLAY_BACKEND_GPIO_4_BITS || DISPLAY_BACKEND_GPIO_8_BITS */
+
+/********************** end of file ******************************************/
@@ -0,0 +1,116 @@
+/*
+ * Copyright (c) 2023 Juan Manuel Cruz <jcruz@fi.uba.ar> <jcruz@frba.utn.edu.ar>.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ * @file   : display_i2c.c
+ * @date   : Ago 14, 2024
+ * @author : Manuel Collazo <mcollazo@fi.uba.ar>
+ * @version	v1.0.0
+ */
+
+/********************** inclusions *******************************************/
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Project includes. */
+#include "main.h"
+
+/* Demo includes. */
+
+/* Application & Tasks includes. */
+#include "display.h"
+#include "display_backend.h"
+
+#if (DISPLAY_BACKEND == DISPLAY_BACKEND_PCF8574) || (DISPLAY_BACKEND == DISPLAY_BACKEND_SSD1306)
+
+/********************** macros and definitions *******************************/
+#define I2C1_SCL_PIN  GPIO_PIN_8
+#define I2C1_SDA_PIN  GPIO_PIN_9
+#define I2C1_GPIO_PORT GPIOB
+
+/* Clock pulses that free a slave stuck in the middle of a byte */
+#define I2C_RECOVERY_CLOCKS   9
+#define I2C_RECOVERY_HALF_US  5
+
+/********************** internal data declaration ****************************/
+
+/********************** internal functions declaration ***********************/
+
+/********************** internal data definition *****************************/
+
+/********************** external data definition *****************************/
+
+/********************** external data declaration ****************************/
+extern I2C_HandleTypeDef hi2c1;
+
+/********************** internal functions definition ************************/
+
+/********************** external functions definition ************************/
+/* Leaves hi2c1 ready whatever state the HAL and the bus were left in by an
+ * aborted transfer. The caller probes its own devices afterwards. */
+bool display_i2c_bus_recover(void)
+{
+    GPIO_InitTypeDef GPIO_InitStruct = {0};
+    uint8_t i;
+
+    HAL_I2C_DeInit(&hi2c1);
+
+    /* Clock a slave holding SDA low out of its byte, then send a STOP */
+    GPIO_InitStruct.Pin = I2C1_SCL_PIN | I2C1_SDA_PIN;
+    GPIO_InitStruct.Mode = GPIO_MODE_OUTPUT_OD;
+    GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_HIGH;
+    HAL_GPIO_WritePin(I2C1_GPIO_PORT, I2C1_SCL_PIN | I2C1_SDA_PIN, GPIO_PIN_SET);
+    HAL_GPIO_Init(I2C1_GPIO_PORT, &GPIO_InitStruct);
+
+    for (i = 0; i < I2C_RECOVERY_CLOCKS && HAL_GPIO_ReadPin(I2C1_GPIO_PORT, I2C1_SDA_PIN) == GPIO_PIN_RESET; i++) {
+        HAL_GPIO_WritePin(I2C1_GPIO_PORT, I2C1_SCL_PIN, GPIO_PIN_RESET);
+        display_delay_us(I2C_RECOVERY_HALF_US);
+        HAL_GPIO_WritePin(I2C1_GPIO_PORT, I2C1_SCL_PIN, GPIO_PIN_SET);
+        display_delay_us(I2C_RECOVERY_HALF_US);
+    }
+
+    HAL_GPIO_WritePin(I2C1_GPIO_PORT, I2C1_SCL_PIN, GPIO_PIN_RESET);
+    HAL_GPIO_WritePin(I2C1_GPIO_PORT, I2C1_SDA_PIN, GPIO_PIN_RESET);
+    display_delay_us(I2C_RECOVERY_HALF_US);
+    HAL_GPIO_WritePin(I2C1_GPIO_PORT, I2C1_SCL_PIN, GPIO_PIN_SET);
+    display_delay_us(I2C_RECOVERY_HALF_US);
+    HAL_GPIO_WritePin(I2C1_GPIO_PORT, I2C1_SDA_PIN, GPIO_PIN_SET);
+    display_delay_us(I2C_RECOVERY_HALF_US);
+
+    /* A peripheral reset clears a BUSY flag latched by the glitch */
+    __HAL_RCC_I2C1_FORCE_RESET();
+    __HAL_RCC_I2C1_RELEASE_RESET();
+    return HAL_I2C_Init(&hi2c1) == HAL_OK;
+}
+
+#endif /* DISPLAY_BACKEND == DISPLAY_BACKEND_PCF8574 || DISPLAY_BACKEND == DISPLAY_BACKEND_SSD1306 */
+
+/********************** end of file ******************************************/
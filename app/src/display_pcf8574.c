@@ -0,0 +1,790 @@
+/*
+ * Copyright (c) 2023 Juan Manuel Cruz <jcruz@fi.uba.ar> <jcruz@frba.utn.edu.ar>.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ * @file   : display_pcf8574.c
+ * @date   : Ago 14, 2024
+ * @author : Manuel Collazo <mcollazo@fi.uba.ar>
+ * @version	v1.0.0
+ */
+
+/********************** inclusions *******************************************/
+#include <stdbool.h>
+#include <string.h>
+
+/* Project includes. */
+#include "main.h"
+
+/* Demo includes. */
+#include "dwt.h"
+
+/* Application & Tasks includes. */
+#include "display.h"
+#include "display_backend.h"
+
+#if (DISPLAY_BACKEND == DISPLAY_BACKEND_PCF8574)
+
+/********************** macros and definitions *******************************/
+/* Poll the busy flag through the expander instead of waiting out the
+ * worst case of slow instructions. Needs RW wired to the expander. */
+#ifndef DISPLAY_PCF8574_BUSY_FLAG_POLLING
+#define DISPLAY_PCF8574_BUSY_FLAG_POLLING 0
+#endif
+
+#define I2C1_SDA PB_9
+#define I2C1_SCL PB_8
+
+/* A transfer that outlives its byte count plus this margin is stuck */
+#ifndef DISPLAY_PCF8574_TRANSFER_MARGIN_US
+#define DISPLAY_PCF8574_TRANSFER_MARGIN_US 2000
+#endif
+
+/* Time between recovery attempts, doubled after each failed one */
+#define PCF8574_RETRY_MIN_MS   10
+#define PCF8574_RETRY_MAX_MS 1000
+#define PCF8574_PROBE_TIMEOUT_MS 2
+
+#define PCF8574_BIT_RS 0b00000001
+#define PCF8574_BIT_RW 0b00000010
+#define PCF8574_BIT_EN 0b00000100
+#define PCF8574_BIT_A  0b00001000
+#define PCF8574_BIT_BF 0b10000000
+
+/* Second enable line of a 40x4 panel, on the RW output since RW is then
+ * tied low */
+#ifndef PCF8574_BIT_EN2
+#define PCF8574_BIT_EN2 PCF8574_BIT_RW
+#endif
+
+#if (DISPLAY_CONTROLLERS > 1) && (DISPLAY_PCF8574_BUSY_FLAG_POLLING == 1)
+#error "Busy flag polling needs RW, which drives the second enable line of a two controller panel"
+#endif
+
+/* Data lines released high so the controller can drive them */
+#define PCF8574_DATA_LINES 0b11110000
+
+#define PCF8574_READ_TIMEOUT_MS 2
+
+#define PCF8574_BURST_MAX_LENGTH 128
+#define PCF8574_BURST_CODE_MAX_LENGTH 5
+#define PCF8574_CODE_LENGTH 4
+#define PCF8574_NIBBLE_LENGTH 2
+
+/* Expander bytes for one code: high nibble with EN high then low, and the
+ * same for the low nibble. The data is latched on the falling edge of EN. */
+#define PCF8574_NIBBLE(nibble, rs) \
+    ((nibble) | PCF8574_BIT_A | PCF8574_BIT_EN | (rs)), ((nibble) | PCF8574_BIT_A | (rs))
+#define PCF8574_CODE(code, rs) \
+    {PCF8574_NIBBLE((code) & 0xF0, rs), PCF8574_NIBBLE(((code) << 4) & 0xF0, rs)}
+#define PCF8574_CODE_4(code, rs) \
+    PCF8574_CODE((code), rs), PCF8574_CODE((code) + 1, rs), \
+    PCF8574_CODE((code) + 2, rs), PCF8574_CODE((code) + 3, rs)
+#define PCF8574_CODE_16(code, rs) \
+    PCF8574_CODE_4((code), rs), PCF8574_CODE_4((code) + 4, rs), \
+    PCF8574_CODE_4((code) + 8, rs), PCF8574_CODE_4((code) + 12, rs)
+#define PCF8574_CODE_64(code, rs) \
+    PCF8574_CODE_16((code), rs), PCF8574_CODE_16((code) + 16, rs), \
+    PCF8574_CODE_16((code) + 32, rs), PCF8574_CODE_16((code) + 48, rs)
+#define PCF8574_CODE_256(rs) \
+    {PCF8574_CODE_64(0, rs), PCF8574_CODE_64(64, rs), \
+     PCF8574_CODE_64(128, rs), PCF8574_CODE_64(192, rs)}
+
+#define PCF8574_TRANSFER_QUEUE_LENGTH 4
+
+typedef struct {
+    uint8_t data[PCF8574_BURST_MAX_LENGTH];
+    uint16_t length;
+} pcf8574_transfer_t;
+
+/* One expander and the bursts encoded for it. The tail slot is the one
+ * being filled, the head slot is the next one to go on the bus. */
+typedef struct {
+    int address;
+    bool display_pin_a;
+    bool initial_8_bit_communication_is_completed;
+
+    /* EN bits of the selected controllers */
+    uint8_t enable_bits;
+
+    /* Last byte put on the expander outputs, unknown until the first write
+     * and after a bus fault */
+    uint8_t burst_last_byte;
+    bool output_is_known;
+
+    struct
+    {
+    	uint32_t	head;
+    	uint32_t	tail;
+    	volatile uint32_t	count;
+    	pcf8574_transfer_t	queue[PCF8574_TRANSFER_QUEUE_LENGTH];
+    } queue_transfer;
+} pcf8574_t;
+
+#define PCF8574_BUS_OWNER_NONE 0xFF
+
+#define I2C_BITS_PER_BYTE 9
+
+/********************** internal data declaration ****************************/
+static pcf8574_t pcf8574[DISPLAY_INSTANCES_MAX];
+
+static volatile bool pcf8574_transfer_busy;
+static volatile uint8_t pcf8574_bus_owner;
+static uint32_t pcf8574_byte_time_us;
+
+/* Deadline of the transfer on the bus */
+static uint32_t pcf8574_transfer_start;
+static uint32_t pcf8574_transfer_deadline_us;
+
+/* Cleared on a stuck or failed transfer, until a recovery succeeds. The
+ * interrupts only raise the fault, the queues are dropped from the main
+ * loop where no burst is being filled. */
+static volatile bool pcf8574_bus_healthy;
+static volatile bool pcf8574_bus_fault_pending;
+static uint32_t pcf8574_retry_tick;
+static uint32_t pcf8574_retry_ms;
+
+#if (DISPLAY_PCF8574_I2C_LL == 1)
+/* Burst to send, the address byte going out once the START condition is
+ * on the bus */
+static volatile uint8_t pcf8574_ll_address;
+static uint8_t *pcf8574_ll_data;
+static uint16_t pcf8574_ll_length;
+
+/* Held back until the previous STOP is over */
+static volatile bool pcf8574_ll_start_pending;
+#endif
+
+/********************** internal functions declaration ***********************/
+static bool display_queue_slot_wait(pcf8574_t *p_pcf8574);
+static pcf8574_transfer_t * display_burst_reserve(pcf8574_t *p_pcf8574, uint16_t length);
+static void display_expander_write(uint8_t id, uint8_t data);
+static void display_transfer_next(void);
+static void display_transfer_done(void);
+#if (DISPLAY_PCF8574_I2C_LL == 1)
+static void display_i2c_ll_start(uint8_t address, uint8_t *p_data, uint16_t length);
+static void display_i2c_ll_transmit(void);
+static void display_i2c_ll_stop(void);
+#endif
+static void display_transfer_poll(void);
+static void display_transfer_wait(pcf8574_t *p_pcf8574);
+static void display_bus_wait_idle(void);
+static bool display_transfer_is_expired(void);
+static void display_bus_fault(void);
+static void display_bus_fault_handle(void);
+static bool display_bus_recover(void);
+#if (DISPLAY_PCF8574_BUSY_FLAG_POLLING == 1)
+static bool display_busy_flag_read(pcf8574_t *p_pcf8574, bool *p_busy, uint8_t *p_address);
+#endif
+
+/********************** internal data definition *****************************/
+/* Ready to send expander bytes for every code, indexed by RS and data byte,
+ * with the backlight on */
+static const uint8_t pcf8574_code_table[2][256][PCF8574_CODE_LENGTH] = {
+    [DISPLAY_RS_INSTRUCTION] = PCF8574_CODE_256(0),
+    [DISPLAY_RS_DATA]        = PCF8574_CODE_256(PCF8574_BIT_RS),
+};
+
+/********************** external data declaration ****************************/
+extern I2C_HandleTypeDef hi2c1;
+
+/********************** internal functions definition ************************/
+/* With every slot in use the tail is the head slot, which is on the bus,
+ * so nothing may be added to it or queued behind it. Returns false when a
+ * fault came up while waiting, nothing may go on the bus before
+ * display_bus_recover(). */
+static bool display_queue_slot_wait(pcf8574_t *p_pcf8574)
+{
+    while (p_pcf8574->queue_transfer.count == PCF8574_TRANSFER_QUEUE_LENGTH && pcf8574_bus_healthy) {
+        display_transfer_poll();
+    }
+    return pcf8574_bus_healthy;
+}
+
+static pcf8574_transfer_t * display_burst_reserve(pcf8574_t *p_pcf8574, uint16_t length)
+{
+    if (display_queue_slot_wait(p_pcf8574) == false)
+        return NULL;
+
+    if (p_pcf8574->queue_transfer.queue[p_pcf8574->queue_transfer.tail].length + length > PCF8574_BURST_MAX_LENGTH) {
+        display_backend_flush(p_pcf8574 - pcf8574);
+        if (display_queue_slot_wait(p_pcf8574) == false)
+            return NULL;
+    }
+
+    return &p_pcf8574->queue_transfer.queue[p_pcf8574->queue_transfer.tail];
+}
+
+static void display_expander_write(uint8_t id, uint8_t data)
+{
+    pcf8574_t *p_pcf8574 = &pcf8574[id];
+    pcf8574_transfer_t *p_burst = display_burst_reserve(p_pcf8574, 1);
+
+    if (p_burst == NULL)
+        return;
+
+    p_burst->data[p_burst->length++] = data;
+    p_pcf8574->burst_last_byte = data;
+    p_pcf8574->output_is_known = true;
+    display_backend_flush(id);
+}
+
+static void display_transfer_next(void)
+{
+    pcf8574_t *p_pcf8574;
+    pcf8574_transfer_t *p_transfer;
+    uint8_t i, id = 0;
+
+    /* Round robin over the panels with pending bursts, so while one panel
+     * waits on its controller the bus carries another panel's bytes */
+    for (i = 1; i <= DISPLAY_INSTANCES_MAX; i++) {
+        id = (pcf8574_bus_owner + i) % DISPLAY_INSTANCES_MAX;
+        if (pcf8574[id].queue_transfer.count > 0)
+            break;
+    }
+    if (i > DISPLAY_INSTANCES_MAX) {
+        pcf8574_transfer_busy = false;
+        return;
+    }
+
+    pcf8574_bus_owner = id;
+    p_pcf8574 = &pcf8574[id];
+    p_transfer = &p_pcf8574->queue_transfer.queue[p_pcf8574->queue_transfer.head];
+
+    pcf8574_transfer_start = cycle_counter_get();
+    pcf8574_transfer_deadline_us = p_transfer->length * pcf8574_byte_time_us + DISPLAY_PCF8574_TRANSFER_MARGIN_US;
+
+    /* The PCF8574 latches every byte of a streamed write, and at 100 kHz
+     * each byte lasts longer than any ordinary instruction execution time */
+#if (DISPLAY_PCF8574_I2C_LL == 1)
+    display_i2c_ll_start((uint8_t)p_pcf8574->address, p_transfer->data, p_transfer->length);
+#else
+    if (HAL_I2C_Master_Transmit_DMA(&hi2c1, (uint16_t)p_pcf8574->address, p_transfer->data, p_transfer->length) != HAL_OK) {
+        HAL_I2C_ErrorCallback(&hi2c1);
+    }
+#endif
+}
+
+static void display_transfer_done(void)
+{
+    pcf8574_t *p_pcf8574 = &pcf8574[pcf8574_bus_owner];
+
+    p_pcf8574->queue_transfer.queue[p_pcf8574->queue_transfer.head].length = 0;
+    p_pcf8574->queue_transfer.head = (p_pcf8574->queue_transfer.head + 1) % PCF8574_TRANSFER_QUEUE_LENGTH;
+    p_pcf8574->queue_transfer.count--;
+
+    display_transfer_next();
+}
+
+#if (DISPLAY_PCF8574_I2C_LL == 1)
+static void display_i2c_ll_start(uint8_t address, uint8_t *p_data, uint16_t length)
+{
+    pcf8574_ll_address = address;
+    pcf8574_ll_data = p_data;
+    pcf8574_ll_length = length;
+
+    /* Errata: a START requested while the previous STOP is still being
+     * generated is ignored. This runs right after the BTF interrupt set
+     * STOP, so rather than spinning there the burst is started by
+     * display_transfer_poll() once the hardware has cleared it. */
+    if (hi2c1.Instance->CR1 & I2C_CR1_STOP) {
+        pcf8574_ll_start_pending = true;
+        return;
+    }
+
+    display_i2c_ll_transmit();
+}
+
+static void display_i2c_ll_transmit(void)
+{
+    I2C_TypeDef *p_i2c = hi2c1.Instance;
+    DMA_Channel_TypeDef *p_dma = hi2c1.hdmatx->Instance;
+
+    /* Errata: a glitch seen by the analog filter can latch BUSY with the
+     * bus idle, only the peripheral reset in the recovery clears it */
+    if (p_i2c->SR2 & I2C_SR2_BUSY) {
+        display_bus_fault();
+        return;
+    }
+
+    p_dma->CCR &= ~DMA_CCR_EN;
+    DMA1->IFCR = DMA_IFCR_CGIF6;
+    p_dma->CPAR = (uint32_t)&p_i2c->DR;
+    p_dma->CMAR = (uint32_t)pcf8574_ll_data;
+    p_dma->CNDTR = pcf8574_ll_length;
+    p_dma->CCR = DMA_CCR_MINC | DMA_CCR_DIR | DMA_CCR_EN;
+
+    /* The event interrupt only sees SB, ADDR and the final BTF, the data
+     * bytes are fed by the DMA on TXE */
+    p_i2c->CR2 |= I2C_CR2_DMAEN | I2C_CR2_ITEVTEN | I2C_CR2_ITERREN;
+    p_i2c->CR1 |= I2C_CR1_START;
+}
+
+static void display_i2c_ll_stop(void)
+{
+    pcf8574_ll_start_pending = false;
+    hi2c1.Instance->CR2 &= ~(I2C_CR2_DMAEN | I2C_CR2_ITEVTEN | I2C_CR2_ITERREN);
+    hi2c1.hdmatx->Instance->CCR &= ~DMA_CCR_EN;
+}
+#endif
+
+/* Called from the main loop and while waiting on the bus, never from the
+ * transfer interrupts */
+static void display_transfer_poll(void)
+{
+#if (DISPLAY_PCF8574_I2C_LL == 1)
+    if (pcf8574_ll_start_pending && (hi2c1.Instance->CR1 & I2C_CR1_STOP) == 0) {
+        pcf8574_ll_start_pending = false;
+        display_i2c_ll_transmit();
+    }
+#endif
+
+    if (display_transfer_is_expired())
+        display_bus_fault();
+
+    if (pcf8574_bus_fault_pending)
+        display_bus_fault_handle();
+}
+
+static void display_transfer_wait(pcf8574_t *p_pcf8574)
+{
+    while (p_pcf8574->queue_transfer.count > 0) {
+        display_transfer_poll();
+    }
+}
+
+static void display_bus_wait_idle(void)
+{
+    while (pcf8574_transfer_busy) {
+        display_transfer_poll();
+    }
+}
+
+static bool display_transfer_is_expired(void)
+{
+    uint32_t now, start, deadline_us;
+    bool busy;
+
+    /* The transfer interrupt chains the next burst, the time, start and
+     * deadline read on both sides of it would not belong together */
+    __asm("CPSID i");	/* disable interrupts*/
+    now = cycle_counter_get();
+    busy = pcf8574_transfer_busy;
+    start = pcf8574_transfer_start;
+    deadline_us = pcf8574_transfer_deadline_us;
+    __asm("CPSIE i");	/* enable interrupts*/
+
+    return busy && (now - start) > deadline_us * cycles_per_us;
+}
+
+/* Also called from the transfer interrupts, so it only stops the bus */
+static void display_bus_fault(void)
+{
+#if (DISPLAY_PCF8574_I2C_LL == 1)
+    display_i2c_ll_stop();
+#else
+    HAL_DMA_Abort(hi2c1.hdmatx);
+#endif
+
+    if (pcf8574_bus_healthy) {
+        pcf8574_bus_healthy = false;
+        pcf8574_bus_fault_pending = true;
+    }
+}
+
+static void display_bus_fault_handle(void)
+{
+    uint8_t id;
+    uint32_t i;
+
+    /* Drop everything queued, the controllers are resynchronized from
+     * scratch once the bus is back */
+    __asm("CPSID i");	/* disable interrupts*/
+    for (id = 0; id < DISPLAY_INSTANCES_MAX; id++) {
+        pcf8574_t *p_pcf8574 = &pcf8574[id];
+
+        for (i = 0; i < PCF8574_TRANSFER_QUEUE_LENGTH; i++)
+            p_pcf8574->queue_transfer.queue[i].length = 0;
+        p_pcf8574->queue_transfer.head = 0;
+        p_pcf8574->queue_transfer.tail = 0;
+        p_pcf8574->queue_transfer.count = 0;
+        p_pcf8574->output_is_known = false;
+    }
+    pcf8574_transfer_busy = false;
+    pcf8574_bus_fault_pending = false;
+    __asm("CPSIE i");	/* enable interrupts*/
+
+    pcf8574_retry_ms = PCF8574_RETRY_MIN_MS;
+    pcf8574_retry_tick = HAL_GetTick();
+}
+
+static bool display_bus_recover(void)
+{
+    uint8_t i;
+
+    if (display_i2c_bus_recover() == false)
+        return false;
+
+    /* Every panel in use has to answer */
+    for (i = 0; i < DISPLAY_INSTANCES_MAX; i++) {
+        if (pcf8574[i].address != 0 && HAL_I2C_IsDeviceReady(&hi2c1, (uint16_t)pcf8574[i].address, 1, PCF8574_PROBE_TIMEOUT_MS) != HAL_OK)
+            return false;
+    }
+    return true;
+}
+
+#if (DISPLAY_PCF8574_BUSY_FLAG_POLLING == 1)
+static bool display_busy_flag_read(pcf8574_t *p_pcf8574, bool *p_busy, uint8_t *p_address)
+{
+    uint8_t read = PCF8574_DATA_LINES | PCF8574_BIT_RW | (p_pcf8574->display_pin_a ? PCF8574_BIT_A : 0);
+    uint8_t strobe[] = {read, read | PCF8574_BIT_EN};
+    uint8_t release[] = {read, read & ~PCF8574_BIT_RW};
+    uint16_t address = (uint16_t)p_pcf8574->address;
+    uint8_t high, low;
+
+    /* Reads are synchronous, so nothing else may be on the bus */
+    display_bus_wait_idle();
+
+    /* Busy flag and AC6..AC4 come with the first EN pulse, AC3..AC0 with
+     * the second one */
+    if (HAL_I2C_Master_Transmit(&hi2c1, address, strobe, sizeof(strobe), PCF8574_READ_TIMEOUT_MS) != HAL_OK ||
+        HAL_I2C_Master_Receive(&hi2c1, address, &high, 1, PCF8574_READ_TIMEOUT_MS) != HAL_OK ||
+        HAL_I2C_Master_Transmit(&hi2c1, address, strobe, sizeof(strobe), PCF8574_READ_TIMEOUT_MS) != HAL_OK ||
+        HAL_I2C_Master_Receive(&hi2c1, address, &low, 1, PCF8574_READ_TIMEOUT_MS) != HAL_OK) {
+        return false;
+    }
+
+    /* Drop EN, then RW, before the next write */
+    if (HAL_I2C_Master_Transmit(&hi2c1, address, release, sizeof(release), PCF8574_READ_TIMEOUT_MS) != HAL_OK)
+        return false;
+    p_pcf8574->burst_last_byte = release[1];
+    p_pcf8574->output_is_known = true;
+
+    *p_busy = (high & PCF8574_BIT_BF) != 0;
+    *p_address = (high & 0x70) | (low >> 4);
+    return true;
+}
+#endif
+
+/********************** external functions definition ************************/
+void display_backend_init(uint8_t id, uint8_t bus_address)
+{
+    pcf8574_t *p_pcf8574 = &pcf8574[id];
+
+    memset(p_pcf8574, 0, sizeof(pcf8574_t));
+    p_pcf8574->address = bus_address;
+    p_pcf8574->enable_bits = PCF8574_BIT_EN;
+    //i2cPcf8574.frequency(100000);
+
+    /* The bus is shared, its state is set up with the first panel */
+    if (pcf8574_byte_time_us == 0) {
+        pcf8574_byte_time_us = (I2C_BITS_PER_BYTE * 1000000) / hi2c1.Init.ClockSpeed;
+        pcf8574_bus_owner = PCF8574_BUS_OWNER_NONE;
+        pcf8574_bus_healthy = true;
+    }
+
+    display_backend_backlight_write(id, ON);
+}
+
+void display_backend_update(void)
+{
+    uint8_t id;
+
+    display_transfer_poll();
+
+    /* A fault raised since the poll is dropped on the next one first */
+    if (pcf8574_bus_healthy || pcf8574_bus_fault_pending || (HAL_GetTick() - pcf8574_retry_tick) < pcf8574_retry_ms)
+        return;
+
+    if (display_bus_recover() == false) {
+        pcf8574_retry_tick = HAL_GetTick();
+        if (pcf8574_retry_ms < PCF8574_RETRY_MAX_MS)
+            pcf8574_retry_ms *= 2;
+        return;
+    }
+
+    /* The controllers may have lost nibble sync, they are brought up again */
+    pcf8574_bus_healthy = true;
+    for (id = 0; id < DISPLAY_INSTANCES_MAX; id++) {
+        if (pcf8574[id].address == 0)
+            continue;
+        pcf8574[id].initial_8_bit_communication_is_completed = false;
+        display_backend_backlight_write(id, pcf8574[id].display_pin_a);
+    }
+}
+
+bool display_backend_is_healthy(void)
+{
+    return pcf8574_bus_healthy;
+}
+
+void display_backend_controller_select(uint8_t id, uint8_t controllers)
+{
+    pcf8574[id].enable_bits = ((controllers & 0x01) ? PCF8574_BIT_EN : 0) | ((controllers & 0x02) ? PCF8574_BIT_EN2 : 0);
+}
+
+void display_backend_4_bits_mode_enter(uint8_t id)
+{
+    pcf8574[id].initial_8_bit_communication_is_completed = true;
+}
+
+void display_backend_code_send(uint8_t id, bool type, uint8_t data_bus)
+{
+    pcf8574_t *p_pcf8574 = &pcf8574[id];
+    pcf8574_transfer_t *p_burst;
+    const uint8_t *p_code = pcf8574_code_table[type][data_bus];
+    uint8_t *p_data;
+    uint8_t length;
+
+    /* Dropped, the frame is re-sent once the bus is back */
+    if (pcf8574_bus_healthy == false)
+        return;
+
+    p_burst = display_burst_reserve(p_pcf8574, PCF8574_BURST_CODE_MAX_LENGTH);
+    if (p_burst == NULL)
+        return;
+
+    /* RS must be stable before EN rises, so settle it first when it changes */
+    if ((p_pcf8574->burst_last_byte ^ p_code[0]) & PCF8574_BIT_RS) {
+        p_burst->data[p_burst->length++] = (p_pcf8574->burst_last_byte & ~PCF8574_BIT_RS) | (p_code[0] & PCF8574_BIT_RS);
+    }
+
+    /* Only the high nibble is clocked in while still in 8 bits mode */
+    length = p_pcf8574->initial_8_bit_communication_is_completed ? PCF8574_CODE_LENGTH : PCF8574_NIBBLE_LENGTH;
+    p_data = &p_burst->data[p_burst->length];
+    memcpy(p_data, p_code, length);
+    p_burst->length += length;
+
+    if (p_pcf8574->display_pin_a == OFF) {
+        for (uint8_t i = 0; i < length; i++)
+            p_data[i] &= ~PCF8574_BIT_A;
+    }
+
+    /* The table strobes the first controller only */
+    if (p_pcf8574->enable_bits != PCF8574_BIT_EN) {
+        for (uint8_t i = 0; i < length; i++)
+            if (p_data[i] & PCF8574_BIT_EN)
+                p_data[i] = (p_data[i] & ~PCF8574_BIT_EN) | p_pcf8574->enable_bits;
+    }
+
+    p_pcf8574->burst_last_byte = p_data[length - 1];
+    p_pcf8574->output_is_known = true;
+}
+
+/* Same encoding as display_backend_code_send() */
+uint32_t display_backend_code_cost(uint8_t id, bool type, uint8_t data_bus)
+{
+    pcf8574_t *p_pcf8574 = &pcf8574[id];
+    const uint8_t *p_code = pcf8574_code_table[type][data_bus];
+    uint32_t cost = p_pcf8574->initial_8_bit_communication_is_completed ? PCF8574_CODE_LENGTH : PCF8574_NIBBLE_LENGTH;
+
+    if ((p_pcf8574->burst_last_byte ^ p_code[0]) & PCF8574_BIT_RS)
+        cost++;
+    return cost;
+}
+
+void display_backend_wait_us(uint8_t id, uint32_t wait_us)
+{
+    pcf8574_t *p_pcf8574 = &pcf8574[id];
+
+    /* The next EN falling edge is at least one expander byte away */
+    if (wait_us <= pcf8574_byte_time_us || pcf8574_bus_healthy == false)
+        return;
+
+    /* The wait counts from the last byte sent to this panel */
+    display_backend_flush(id);
+    display_transfer_wait(p_pcf8574);
+
+#if (DISPLAY_PCF8574_BUSY_FLAG_POLLING == 1)
+    /* The busy flag only reads back correctly once in 4 bits mode. The
+     * worst case wait still bounds the poll if reads keep failing. */
+    if (p_pcf8574->initial_8_bit_communication_is_completed) {
+        uint32_t start = cycle_counter_get();
+        bool busy;
+        uint8_t address;
+
+        do {
+            if (display_busy_flag_read(p_pcf8574, &busy, &address) == false) {
+                display_bus_fault();
+                return;
+            }
+            if (busy == false)
+                return;
+        } while ((cycle_counter_get() - start) < wait_us * cycles_per_us);
+        return;
+    }
+#endif
+
+    display_delay_us(wait_us);
+}
+
+void display_backend_flush(uint8_t id)
+{
+    pcf8574_t *p_pcf8574 = &pcf8574[id];
+    bool start_required = false;
+
+    /* Bytes encoded before a fault are stale, the controllers are brought
+     * up again from scratch after the recovery */
+    if (display_queue_slot_wait(p_pcf8574) == false)
+        return;
+
+    if (p_pcf8574->queue_transfer.queue[p_pcf8574->queue_transfer.tail].length == 0)
+        return;
+
+    /* Protect shared resource (queue_transfer), a fault raised by the
+     * transfer interrupt since the wait keeps the bus stopped */
+    __asm("CPSID i");	/* disable interrupts*/
+    if (pcf8574_bus_healthy == false) {
+        __asm("CPSIE i");	/* enable interrupts*/
+        return;
+    }
+    p_pcf8574->queue_transfer.tail = (p_pcf8574->queue_transfer.tail + 1) % PCF8574_TRANSFER_QUEUE_LENGTH;
+    p_pcf8574->queue_transfer.count++;
+    if (pcf8574_transfer_busy == false) {
+        pcf8574_transfer_busy = true;
+        start_required = true;
+    }
+    __asm("CPSIE i");	/* enable interrupts*/
+
+    if (start_required)
+        display_transfer_next();
+}
+
+bool display_backend_is_busy(uint8_t id)
+{
+    return pcf8574[id].queue_transfer.count > 0;
+}
+
+bool display_backend_address_counter_read(uint8_t id, uint8_t *p_address)
+{
+#if (DISPLAY_PCF8574_BUSY_FLAG_POLLING == 1)
+    pcf8574_t *p_pcf8574 = &pcf8574[id];
+    bool busy;
+
+    if (p_pcf8574->initial_8_bit_communication_is_completed == false)
+        return false;
+
+    if (pcf8574_bus_healthy == false)
+        return false;
+
+    display_backend_flush(id);
+    if (display_busy_flag_read(p_pcf8574, &busy, p_address) == false) {
+        display_bus_fault();
+        return false;
+    }
+
+    /* The counter is updated right after the busy flag clears */
+    return busy == false;
+#else
+    return false;
+#endif
+}
+
+void display_backend_backlight_write(uint8_t id, bool on)
+{
+    pcf8574_t *p_pcf8574 = &pcf8574[id];
+    uint8_t data = on ? (p_pcf8574->burst_last_byte | PCF8574_BIT_A) : (p_pcf8574->burst_last_byte & ~PCF8574_BIT_A);
+
+    p_pcf8574->display_pin_a = on;
+    if (pcf8574_bus_healthy == false)
+        return;
+
+    /* No output would change */
+    if (p_pcf8574->output_is_known && data == p_pcf8574->burst_last_byte)
+        return;
+
+    display_expander_write(id, data);
+}
+
+void display_backend_refresh(uint8_t id)
+{
+    if (pcf8574_bus_healthy == false)
+        return;
+
+    /* Re-assert the outputs, in case the expander was reset behind our back */
+    display_expander_write(id, pcf8574[id].burst_last_byte);
+}
+
+#if (DISPLAY_PCF8574_I2C_LL == 1)
+void display_backend_i2c_ev_irq(void)
+{
+    I2C_TypeDef *p_i2c = hi2c1.Instance;
+    uint32_t sr1 = p_i2c->SR1;
+
+    if (sr1 & I2C_SR1_SB) {
+        p_i2c->DR = pcf8574_ll_address;
+    }
+    else if (sr1 & I2C_SR1_ADDR) {
+        /* Reading SR2 after SR1 clears ADDR and releases SCL to the DMA */
+        (void)p_i2c->SR2;
+    }
+    else if ((sr1 & I2C_SR1_BTF) && hi2c1.hdmatx->Instance->CNDTR == 0) {
+        /* SCL is stretched while BTF is set, so STOP is requested before
+         * anything else can be clocked out, as the errata asks */
+        p_i2c->CR1 |= I2C_CR1_STOP;
+        display_i2c_ll_stop();
+        if (pcf8574_bus_owner != PCF8574_BUS_OWNER_NONE)
+            display_transfer_done();
+    }
+}
+
+void display_backend_i2c_er_irq(void)
+{
+    I2C_TypeDef *p_i2c = hi2c1.Instance;
+
+    /* The master still owns the bus after a NACK and has to release it */
+    if (p_i2c->SR1 & I2C_SR1_AF)
+        p_i2c->CR1 |= I2C_CR1_STOP;
+    p_i2c->SR1 = (uint32_t)~(I2C_SR1_AF | I2C_SR1_ARLO | I2C_SR1_BERR | I2C_SR1_OVR | I2C_SR1_TIMEOUT);
+
+    display_bus_fault();
+}
+#endif
+
+void HAL_I2C_MasterTxCpltCallback(I2C_HandleTypeDef *hi2c)
+{
+    if (hi2c->Instance != hi2c1.Instance || pcf8574_bus_owner == PCF8574_BUS_OWNER_NONE)
+        return;
+
+    display_transfer_done();
+}
+
+void HAL_I2C_ErrorCallback(I2C_HandleTypeDef *hi2c)
+{
+    if (hi2c->Instance != hi2c1.Instance)
+        return;
+
+    /* NACK, arbitration lost or bus error, recovered from display_update() */
+    display_bus_fault();
+}
+
+#endif /* DISPLAY_BACKEND == DISPLAY_BACKEND_PCF8574 */
+
+/********************** end of file ******************************************/
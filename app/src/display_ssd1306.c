@@ -0,0 +1,784 @@
+/*
+ * Copyright (c) 2023 Juan Manuel Cruz <jcruz@fi.uba.ar> <jcruz@frba.utn.edu.ar>.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ * @file   : display_ssd1306.c
+ * @date   : Ago 14, 2024
+ * @author : Manuel Collazo <mcollazo@fi.uba.ar>
+ * @version	v1.0.0
+ */
+
+/********************** inclusions *******************************************/
+#include <stdbool.h>
+#include <string.h>
+
+/* Project includes. */
+#include "main.h"
+
+/* Demo includes. */
+#include "dwt.h"
+
+/* Application & Tasks includes. */
+#include "display.h"
+#include "display_backend.h"
+#include "graphics.h"
+
+#if (DISPLAY_BACKEND == DISPLAY_BACKEND_SSD1306)
+
+/********************** macros and definitions *******************************/
+#define SSD1306_WIDTH  128
+#define SSD1306_PAGES  8
+#define SSD1306_PAGE_ROWS 8
+
+/* Control byte sent before the payload of every transfer */
+#define SSD1306_CONTROL_COMMAND 0x00
+#define SSD1306_CONTROL_DATA    0x40
+
+#define SSD1306_CMD_DISPLAY_OFF     0xAE
+#define SSD1306_CMD_DISPLAY_ON      0xAF
+#define SSD1306_CMD_COLUMN_ADDRESS  0x21
+#define SSD1306_CMD_PAGE_ADDRESS    0x22
+
+/* The text geometry is drawn with a 6x8 font, columns centered and rows
+ * spread evenly over the pages */
+#define SSD1306_FONT_WIDTH  6
+#define SSD1306_FONT_FIRST  ' '
+#define SSD1306_FONT_LAST   '~'
+#define SSD1306_TEXT_X       ((SSD1306_WIDTH - DISPLAY_COLUMNS * SSD1306_FONT_WIDTH) / 2)
+#define SSD1306_TEXT_PAGE_STRIDE (SSD1306_PAGES / DISPLAY_ROWS)
+
+#if (DISPLAY_COLUMNS * SSD1306_FONT_WIDTH > SSD1306_WIDTH) || (DISPLAY_CONTROLLERS > 1)
+#error "DISPLAY_GEOMETRY does not fit a 128x64 SSD1306"
+#endif
+
+/* Emulated DDRAM and CGRAM of the HD44780 the text layer talks to */
+#define SSD1306_DDRAM_SIZE 128
+#define SSD1306_DDRAM_LINE_2 0x40
+#define SSD1306_DDRAM_LINE_LENGTH 40
+#define SSD1306_CGRAM_SIZE 64
+#define SSD1306_CGRAM_CHARACTERS 8
+#define SSD1306_CGRAM_WIDTH 5
+
+#define SSD1306_INIT_TIMEOUT_MS 10
+
+/* A transfer that outlives its byte count plus this margin is stuck */
+#ifndef DISPLAY_SSD1306_TRANSFER_MARGIN_US
+#define DISPLAY_SSD1306_TRANSFER_MARGIN_US 2000
+#endif
+
+/* Time between recovery attempts, doubled after each failed one */
+#define SSD1306_RETRY_MIN_MS   10
+#define SSD1306_RETRY_MAX_MS 1000
+
+/* Blink period of the HD44780 at its nominal 270 kHz clock */
+#define SSD1306_BLINK_MS 400
+
+/* Cursor decorations drawn over the cell at the address counter */
+#define SSD1306_CURSOR_NONE      0
+#define SSD1306_CURSOR_UNDERLINE 0x01
+#define SSD1306_CURSOR_BLOCK     0x02
+#define SSD1306_CURSOR_ADDRESS_NONE 0xFF
+#define SSD1306_CURSOR_ROWS_ALL  0x1F
+
+#define I2C_BITS_PER_BYTE 9
+
+/* Addressing commands of a window and the control bytes of its command and
+ * data transfers */
+#define SSD1306_WINDOW_BYTES (6 + 2)
+
+/* Columns first..last of a page differ from the controller. Clean pages
+ * have first above last. */
+typedef struct {
+    uint8_t column_first;
+    uint8_t column_last;
+} ssd1306_dirty_t;
+
+/********************** internal data declaration ****************************/
+static uint8_t ssd1306_address;
+static uint32_t ssd1306_pixels[GRAPHICS_SURFACE_WORDS(SSD1306_WIDTH, SSD1306_PAGES * SSD1306_PAGE_ROWS)];
+static graphics_surface_t ssd1306_surface;
+static ssd1306_dirty_t ssd1306_dirty[SSD1306_PAGES];
+
+/* Character drawn in each cell, so rewriting the same one costs nothing */
+static uint8_t ssd1306_cell_character[DISPLAY_ROWS][DISPLAY_COLUMNS];
+
+/* Page packed from the surface in controller layout */
+static uint8_t ssd1306_page[SSD1306_WIDTH];
+
+/* Window data, page after page, packed before the transfer starts so the
+ * Tx-complete callback never reads the surface the main loop draws on */
+static uint8_t ssd1306_window[SSD1306_PAGES * SSD1306_WIDTH];
+
+static uint8_t ssd1306_ddram[SSD1306_DDRAM_SIZE];
+static uint8_t ssd1306_cgram[SSD1306_CGRAM_SIZE];
+static uint8_t ssd1306_address_counter;
+static uint8_t ssd1306_cgram_address;
+static bool ssd1306_cgram_selected;
+
+/* The panel is lit when both the text layer and the backlight want it */
+static bool ssd1306_display_on;
+static bool ssd1306_backlight_on;
+static bool ssd1306_panel_on_sent;
+
+/* Cursor and blink as last set by the text layer, and the cell and
+ * decoration drawn for them */
+static bool ssd1306_cursor_on;
+static bool ssd1306_blink_on;
+static bool ssd1306_blink_phase;
+static uint32_t ssd1306_blink_tick;
+static uint8_t ssd1306_cursor_address;
+static uint8_t ssd1306_cursor_decoration;
+
+/* Window being pushed, written by the main loop before the transfer
+ * starts. The Tx-complete callback sends the data after the addressing
+ * commands and clears the length once it is on its way. */
+static volatile bool ssd1306_transfer_busy;
+static uint16_t ssd1306_window_length;
+static uint8_t ssd1306_command[7];
+
+static uint32_t ssd1306_byte_time_us;
+static uint32_t ssd1306_transfer_start;
+static uint32_t ssd1306_transfer_deadline_us;
+
+static volatile bool ssd1306_bus_healthy;
+static uint32_t ssd1306_retry_tick;
+static uint32_t ssd1306_retry_ms;
+
+/********************** internal functions declaration ***********************/
+static bool ssd1306_controller_init(void);
+static void ssd1306_dirty_all(void);
+static void ssd1306_dirty_collect(void);
+static uint32_t ssd1306_dirty_bytes(const ssd1306_dirty_t *p_dirty);
+static bool ssd1306_cell_locate(uint8_t address, uint8_t *p_row, uint8_t *p_column);
+static void ssd1306_cell_dirty_add(ssd1306_dirty_t *p_dirty, uint8_t address);
+static uint8_t ssd1306_address_next(uint8_t address);
+static void ssd1306_cell_render(uint8_t address, bool force);
+static void ssd1306_character_render(uint8_t character);
+static void ssd1306_cursor_update(void);
+static bool ssd1306_transfer_start_dma(uint8_t control, uint8_t *p_data, uint16_t length);
+static void ssd1306_push_next(void);
+static void ssd1306_window_data_send(void);
+static bool ssd1306_transfer_is_expired(void);
+static void ssd1306_bus_fault(void);
+
+/********************** internal data definition *****************************/
+/* Charge pump on, horizontal addressing, rows and columns remapped so the
+ * panel reads with the connector on top. The panel stays off until the
+ * text layer turns it on. */
+static const uint8_t ssd1306_init_sequence[] = {
+    SSD1306_CMD_DISPLAY_OFF,
+    0xD5, 0x80,     /* clock divide */
+    0xA8, 0x3F,     /* multiplex 64 */
+    0xD3, 0x00,     /* display offset */
+    0x40,           /* start line 0 */
+    0x8D, 0x14,     /* charge pump */
+    0x20, 0x00,     /* horizontal addressing */
+    0xA1,           /* segment remap */
+    0xC8,           /* COM scan descending */
+    0xDA, 0x12,     /* COM pins */
+    0x81, 0xCF,     /* contrast */
+    0xD9, 0xF1,     /* precharge */
+    0xDB, 0x40,     /* VCOMH */
+    0xA4,           /* follow RAM */
+    0xA6,           /* not inverted */
+};
+
+/* 5x7 characters from ' ' to '~', one byte per column, bit 0 on top. The
+ * sixth column is the spacing. */
+static const uint8_t ssd1306_font[SSD1306_FONT_LAST - SSD1306_FONT_FIRST + 1][5] = {
+    {0x00, 0x00, 0x00, 0x00, 0x00}, {0x00, 0x00, 0x5F, 0x00, 0x00}, {0x00, 0x07, 0x00, 0x07, 0x00}, {0x14, 0x7F, 0x14, 0x7F, 0x14},
+    {0x24, 0x2A, 0x7F, 0x2A, 0x12}, {0x23, 0x13, 0x08, 0x64, 0x62}, {0x36, 0x49, 0x55, 0x22, 0x50}, {0x00, 0x05, 0x03, 0x00, 0x00},
+    {0x00, 0x1C, 0x22, 0x41, 0x00}, {0x00, 0x41, 0x22, 0x1C, 0x00}, {0x14, 0x08, 0x3E, 0x08, 0x14}, {0x08, 0x08, 0x3E, 0x08, 0x08},
+    {0x00, 0x50, 0x30, 0x00, 0x00}, {0x08, 0x08, 0x08, 0x08, 0x08}, {0x00, 0x60, 0x60, 0x00, 0x00}, {0x20, 0x10, 0x08, 0x04, 0x02},
+    {0x3E, 0x51, 0x49, 0x45, 0x3E}, {0x00, 0x42, 0x7F, 0x40, 0x00}, {0x42, 0x61, 0x51, 0x49, 0x46}, {0x21, 0x41, 0x45, 0x4B, 0x31},
+    {0x18, 0x14, 0x12, 0x7F, 0x10}, {0x27, 0x45, 0x45, 0x45, 0x39}, {0x3C, 0x4A, 0x49, 0x49, 0x30}, {0x01, 0x71, 0x09, 0x05, 0x03},
+    {0x36, 0x49, 0x49, 0x49, 0x36}, {0x06, 0x49, 0x49, 0x29, 0x1E}, {0x00, 0x36, 0x36, 0x00, 0x00}, {0x00, 0x56, 0x36, 0x00, 0x00},
+    {0x08, 0x14, 0x22, 0x41, 0x00}, {0x14, 0x14, 0x14, 0x14, 0x14}, {0x00, 0x41, 0x22, 0x14, 0x08}, {0x02, 0x01, 0x51, 0x09, 0x06},
+    {0x32, 0x49, 0x79, 0x41, 0x3E}, {0x7E, 0x11, 0x11, 0x11, 0x7E}, {0x7F, 0x49, 0x49, 0x49, 0x36}, {0x3E, 0x41, 0x41, 0x41, 0x22},
+    {0x7F, 0x41, 0x41, 0x22, 0x1C}, {0x7F, 0x49, 0x49, 0x49, 0x41}, {0x7F, 0x09, 0x09, 0x09, 0x01}, {0x3E, 0x41, 0x49, 0x49, 0x7A},
+    {0x7F, 0x08, 0x08, 0x08, 0x7F}, {0x00, 0x41, 0x7F, 0x41, 0x00}, {0x20, 0x40, 0x41, 0x3F, 0x01}, {0x7F, 0x08, 0x14, 0x22, 0x41},
+    {0x7F, 0x40, 0x40, 0x40, 0x40}, {0x7F, 0x02, 0x0C, 0x02, 0x7F}, {0x7F, 0x04, 0x08, 0x10, 0x7F}, {0x3E, 0x41, 0x41, 0x41, 0x3E},
+    {0x7F, 0x09, 0x09, 0x09, 0x06}, {0x3E, 0x41, 0x51, 0x21, 0x5E}, {0x7F, 0x09, 0x19, 0x29, 0x46}, {0x46, 0x49, 0x49, 0x49, 0x31},
+    {0x01, 0x01, 0x7F, 0x01, 0x01}, {0x3F, 0x40, 0x40, 0x40, 0x3F}, {0x1F, 0x20, 0x40, 0x20, 0x1F}, {0x3F, 0x40, 0x38, 0x40, 0x3F},
+    {0x63, 0x14, 0x08, 0x14, 0x63}, {0x07, 0x08, 0x70, 0x08, 0x07}, {0x61, 0x51, 0x49, 0x45, 0x43}, {0x00, 0x7F, 0x41, 0x41, 0x00},
+    {0x02, 0x04, 0x08, 0x10, 0x20}, {0x00, 0x41, 0x41, 0x7F, 0x00}, {0x04, 0x02, 0x01, 0x02, 0x04}, {0x40, 0x40, 0x40, 0x40, 0x40},
+    {0x00, 0x01, 0x02, 0x04, 0x00}, {0x20, 0x54, 0x54, 0x54, 0x78}, {0x7F, 0x48, 0x44, 0x44, 0x38}, {0x38, 0x44, 0x44, 0x44, 0x20},
+    {0x38, 0x44, 0x44, 0x48, 0x7F}, {0x38, 0x54, 0x54, 0x54, 0x18}, {0x08, 0x7E, 0x09, 0x01, 0x02}, {0x0C, 0x52, 0x52, 0x52, 0x3E},
+    {0x7F, 0x08, 0x04, 0x04, 0x78}, {0x00, 0x44, 0x7D, 0x40, 0x00}, {0x20, 0x40, 0x44, 0x3D, 0x00}, {0x7F, 0x10, 0x28, 0x44, 0x00},
+    {0x00, 0x41, 0x7F, 0x40, 0x00}, {0x7C, 0x04, 0x18, 0x04, 0x78}, {0x7C, 0x08, 0x04, 0x04, 0x78}, {0x38, 0x44, 0x44, 0x44, 0x38},
+    {0x7C, 0x14, 0x14, 0x14, 0x08}, {0x08, 0x14, 0x14, 0x18, 0x7C}, {0x7C, 0x08, 0x04, 0x04, 0x08}, {0x48, 0x54, 0x54, 0x54, 0x20},
+    {0x04, 0x3F, 0x44, 0x40, 0x20}, {0x3C, 0x40, 0x40, 0x20, 0x7C}, {0x1C, 0x20, 0x40, 0x20, 0x1C}, {0x3C, 0x40, 0x30, 0x40, 0x3C},
+    {0x44, 0x28, 0x10, 0x28, 0x44}, {0x0C, 0x50, 0x50, 0x50, 0x3C}, {0x44, 0x64, 0x54, 0x4C, 0x44}, {0x00, 0x08, 0x36, 0x41, 0x00},
+    {0x00, 0x00, 0x7F, 0x00, 0x00}, {0x00, 0x41, 0x36, 0x08, 0x00}, {0x02, 0x01, 0x02, 0x04, 0x02},
+};
+
+/********************** external data declaration ****************************/
+extern I2C_HandleTypeDef hi2c1;
+
+/********************** internal functions definition ************************/
+static bool ssd1306_controller_init(void)
+{
+    return HAL_I2C_Mem_Write(&hi2c1, ssd1306_address, SSD1306_CONTROL_COMMAND, I2C_MEMADD_SIZE_8BIT,
+                             (uint8_t *)ssd1306_init_sequence, sizeof(ssd1306_init_sequence), SSD1306_INIT_TIMEOUT_MS) == HAL_OK;
+}
+
+static void ssd1306_dirty_all(void)
+{
+    uint8_t page;
+
+    for (page = 0; page < SSD1306_PAGES; page++) {
+        ssd1306_dirty[page].column_first = 0;
+        ssd1306_dirty[page].column_last = SSD1306_WIDTH - 1;
+    }
+}
+
+/* Moves what was drawn on the surface since the last call into the page
+ * column ranges */
+static void ssd1306_dirty_collect(void)
+{
+    graphics_rect_t rect;
+    uint8_t page;
+
+    if (graphics_dirty_get(&ssd1306_surface, &rect) == false)
+        return;
+    graphics_dirty_clear(&ssd1306_surface);
+
+    for (page = rect.y / SSD1306_PAGE_ROWS; page <= (rect.y + rect.height - 1) / SSD1306_PAGE_ROWS; page++) {
+        if (ssd1306_dirty[page].column_first > rect.x)
+            ssd1306_dirty[page].column_first = rect.x;
+        if (ssd1306_dirty[page].column_last < rect.x + rect.width - 1)
+            ssd1306_dirty[page].column_last = rect.x + rect.width - 1;
+    }
+}
+
+/* Bytes ssd1306_push_next() takes to send the dirty ranges, one window per
+ * run of dirty pages */
+static uint32_t ssd1306_dirty_bytes(const ssd1306_dirty_t *p_dirty)
+{
+    uint32_t bytes = 0;
+    uint8_t page = 0, pages, first, last;
+
+    while (page < SSD1306_PAGES) {
+        if (p_dirty[page].column_first > p_dirty[page].column_last) {
+            page++;
+            continue;
+        }
+
+        first = SSD1306_WIDTH;
+        last = 0;
+        for (pages = 0; page < SSD1306_PAGES && p_dirty[page].column_first <= p_dirty[page].column_last; page++, pages++) {
+            if (first > p_dirty[page].column_first)
+                first = p_dirty[page].column_first;
+            if (last < p_dirty[page].column_last)
+                last = p_dirty[page].column_last;
+        }
+        bytes += SSD1306_WINDOW_BYTES + pages * (last - first + 1);
+    }
+    return bytes;
+}
+
+/* False for an address that is not a visible cell */
+static bool ssd1306_cell_locate(uint8_t address, uint8_t *p_row, uint8_t *p_column)
+{
+    uint8_t row;
+
+    for (row = 0; row < DISPLAY_ROWS; row++) {
+        if (address >= display_geometry.row_address[row] && address < display_geometry.row_address[row] + DISPLAY_COLUMNS) {
+            *p_row = row;
+            *p_column = address - display_geometry.row_address[row];
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Marks the columns ssd1306_cell_render() would draw for the cell */
+static void ssd1306_cell_dirty_add(ssd1306_dirty_t *p_dirty, uint8_t address)
+{
+    uint8_t row, column, page, x;
+
+    if (ssd1306_cell_locate(address, &row, &column) == false)
+        return;
+
+    page = row * SSD1306_TEXT_PAGE_STRIDE;
+    x = SSD1306_TEXT_X + column * SSD1306_FONT_WIDTH;
+    if (p_dirty[page].column_first > x)
+        p_dirty[page].column_first = x;
+    if (p_dirty[page].column_last < x + SSD1306_FONT_WIDTH - 1)
+        p_dirty[page].column_last = x + SSD1306_FONT_WIDTH - 1;
+}
+
+/* Same wrap as the controller: end of line 1 to line 2 and back */
+static uint8_t ssd1306_address_next(uint8_t address)
+{
+    address++;
+    if (address == SSD1306_DDRAM_LINE_LENGTH)
+        return SSD1306_DDRAM_LINE_2;
+    if (address == SSD1306_DDRAM_LINE_2 + SSD1306_DDRAM_LINE_LENGTH)
+        return 0;
+    return address;
+}
+
+static void ssd1306_cell_render(uint8_t address, bool force)
+{
+    uint8_t character = ssd1306_ddram[address];
+    uint8_t rows[SSD1306_PAGE_ROWS] = {0};
+    uint8_t row, column, i, r;
+
+    /* Not a visible cell */
+    if (ssd1306_cell_locate(address, &row, &column) == false)
+        return;
+
+    /* Only cells that change go on the bus. CGRAM characters are forced
+     * when their pattern changes. */
+    if (force == false && ssd1306_cell_character[row][column] == character)
+        return;
+    ssd1306_cell_character[row][column] = character;
+
+    /* Glyph rows for the graphics layer, bit 0 on the left */
+    if (character < SSD1306_CGRAM_CHARACTERS * 2) {
+        /* CGRAM rows are 5 dots wide, bit 4 on the left */
+        const uint8_t *p_rows = &ssd1306_cgram[(character % SSD1306_CGRAM_CHARACTERS) * SSD1306_PAGE_ROWS];
+
+        for (r = 0; r < SSD1306_PAGE_ROWS; r++)
+            for (i = 0; i < SSD1306_CGRAM_WIDTH; i++)
+                if (p_rows[r] & (0x10 >> i))
+                    rows[r] |= 1 << i;
+    }
+    else if (character >= SSD1306_FONT_FIRST && character <= SSD1306_FONT_LAST) {
+        /* The font is stored by columns, bit 0 on top */
+        const uint8_t *p_columns = ssd1306_font[character - SSD1306_FONT_FIRST];
+
+        for (i = 0; i < SSD1306_CGRAM_WIDTH; i++)
+            for (r = 0; r < SSD1306_PAGE_ROWS; r++)
+                if (p_columns[i] & (1 << r))
+                    rows[r] |= 1 << i;
+    }
+
+    if (address == ssd1306_cursor_address) {
+        if (ssd1306_cursor_decoration & SSD1306_CURSOR_UNDERLINE)
+            rows[SSD1306_PAGE_ROWS - 1] |= SSD1306_CURSOR_ROWS_ALL;
+        if (ssd1306_cursor_decoration & SSD1306_CURSOR_BLOCK)
+            memset(rows, SSD1306_CURSOR_ROWS_ALL, sizeof(rows));
+    }
+
+    graphics_glyph_draw(&ssd1306_surface, SSD1306_TEXT_X + column * SSD1306_FONT_WIDTH, row * SSD1306_TEXT_PAGE_STRIDE * SSD1306_PAGE_ROWS,
+                        rows, SSD1306_FONT_WIDTH, SSD1306_PAGE_ROWS, GRAPHICS_OP_COPY);
+    ssd1306_dirty_collect();
+}
+
+static void ssd1306_character_render(uint8_t character)
+{
+    uint8_t address;
+
+    /* Characters 8..15 show the same CGRAM patterns as 0..7 */
+    for (address = 0; address < SSD1306_DDRAM_SIZE; address++) {
+        if (ssd1306_ddram[address] % SSD1306_CGRAM_CHARACTERS == character && ssd1306_ddram[address] < SSD1306_CGRAM_CHARACTERS * 2)
+            ssd1306_cell_render(address, true);
+    }
+}
+
+/* Moves the cursor to the cell at the address counter. Both the cell it
+ * leaves and the one it lands on are drawn again. */
+static void ssd1306_cursor_update(void)
+{
+    uint8_t address = SSD1306_CURSOR_ADDRESS_NONE;
+    uint8_t decoration = SSD1306_CURSOR_NONE;
+    uint8_t address_previous = ssd1306_cursor_address;
+
+    if (ssd1306_cursor_on)
+        decoration |= SSD1306_CURSOR_UNDERLINE;
+    if (ssd1306_blink_on && ssd1306_blink_phase)
+        decoration |= SSD1306_CURSOR_BLOCK;
+    if (ssd1306_display_on && ssd1306_cgram_selected == false && (ssd1306_cursor_on || ssd1306_blink_on))
+        address = ssd1306_address_counter;
+
+    if (address == ssd1306_cursor_address && decoration == ssd1306_cursor_decoration)
+        return;
+
+    ssd1306_cursor_address = address;
+    ssd1306_cursor_decoration = decoration;
+    if (address_previous != SSD1306_CURSOR_ADDRESS_NONE)
+        ssd1306_cell_render(address_previous, true);
+    if (address != SSD1306_CURSOR_ADDRESS_NONE && address != address_previous)
+        ssd1306_cell_render(address, true);
+}
+
+static bool ssd1306_transfer_start_dma(uint8_t control, uint8_t *p_data, uint16_t length)
+{
+    ssd1306_transfer_start = cycle_counter_get();
+    ssd1306_transfer_deadline_us = (length + 1) * ssd1306_byte_time_us + DISPLAY_SSD1306_TRANSFER_MARGIN_US;
+
+    return HAL_I2C_Mem_Write_DMA(&hi2c1, ssd1306_address, control, I2C_MEMADD_SIZE_8BIT, p_data, length) == HAL_OK;
+}
+
+/* Called from the main loop only, so the dirty ranges are never read while
+ * the text layer writes them */
+static void ssd1306_push_next(void)
+{
+    bool panel_on = ssd1306_display_on && ssd1306_backlight_on;
+    uint8_t page, page_first, page_last, first = SSD1306_WIDTH, last = 0;
+
+    if (ssd1306_transfer_busy || ssd1306_bus_healthy == false)
+        return;
+
+    if (panel_on != ssd1306_panel_on_sent) {
+        ssd1306_command[0] = panel_on ? SSD1306_CMD_DISPLAY_ON : SSD1306_CMD_DISPLAY_OFF;
+        ssd1306_panel_on_sent = panel_on;
+        ssd1306_window_length = 0;
+        ssd1306_transfer_busy = true;
+        if (ssd1306_transfer_start_dma(SSD1306_CONTROL_COMMAND, ssd1306_command, 1) == false)
+            ssd1306_bus_fault();
+        return;
+    }
+
+    /* One window over the run of dirty pages from the first one, with the
+     * union of their column ranges */
+    for (page = 0; page < SSD1306_PAGES && ssd1306_dirty[page].column_first > ssd1306_dirty[page].column_last; page++) {
+    }
+    if (page == SSD1306_PAGES)
+        return;
+
+    page_first = page;
+    for (; page < SSD1306_PAGES && ssd1306_dirty[page].column_first <= ssd1306_dirty[page].column_last; page++) {
+        if (first > ssd1306_dirty[page].column_first)
+            first = ssd1306_dirty[page].column_first;
+        if (last < ssd1306_dirty[page].column_last)
+            last = ssd1306_dirty[page].column_last;
+        ssd1306_dirty[page].column_first = SSD1306_WIDTH;
+        ssd1306_dirty[page].column_last = 0;
+    }
+    page_last = page - 1;
+
+    /* Horizontal addressing wraps from the last column of the window to the
+     * first one of the next page, so the data follows page by page */
+    ssd1306_window_length = 0;
+    for (page = page_first; page <= page_last; page++) {
+        graphics_page_pack(&ssd1306_surface, page, ssd1306_page);
+        memcpy(&ssd1306_window[ssd1306_window_length], &ssd1306_page[first], last - first + 1);
+        ssd1306_window_length += last - first + 1;
+    }
+
+    ssd1306_command[0] = SSD1306_CMD_COLUMN_ADDRESS;
+    ssd1306_command[1] = first;
+    ssd1306_command[2] = last;
+    ssd1306_command[3] = SSD1306_CMD_PAGE_ADDRESS;
+    ssd1306_command[4] = page_first;
+    ssd1306_command[5] = page_last;
+
+    ssd1306_transfer_busy = true;
+    if (ssd1306_transfer_start_dma(SSD1306_CONTROL_COMMAND, ssd1306_command, 6) == false)
+        ssd1306_bus_fault();
+}
+
+/* Called from the Tx-complete callback, sends the window packed by
+ * ssd1306_push_next() once its addressing commands are through */
+static void ssd1306_window_data_send(void)
+{
+    uint16_t length = ssd1306_window_length;
+
+    if (length == 0) {
+        ssd1306_transfer_busy = false;
+        return;
+    }
+
+    ssd1306_window_length = 0;
+    if (ssd1306_transfer_start_dma(SSD1306_CONTROL_DATA, ssd1306_window, length) == false)
+        ssd1306_bus_fault();
+}
+
+static bool ssd1306_transfer_is_expired(void)
+{
+    uint32_t now, start, deadline_us;
+    bool busy;
+
+    /* The Tx-complete callback starts the window data, the time, start
+     * and deadline read on both sides of it would not belong together */
+    __asm("CPSID i");	/* disable interrupts*/
+    now = cycle_counter_get();
+    busy = ssd1306_transfer_busy;
+    start = ssd1306_transfer_start;
+    deadline_us = ssd1306_transfer_deadline_us;
+    __asm("CPSIE i");	/* enable interrupts*/
+
+    return busy && (now - start) > deadline_us * cycles_per_us;
+}
+
+static void ssd1306_bus_fault(void)
+{
+    HAL_DMA_Abort(hi2c1.hdmatx);
+
+    ssd1306_transfer_busy = false;
+    if (ssd1306_bus_healthy) {
+        ssd1306_bus_healthy = false;
+        ssd1306_retry_ms = SSD1306_RETRY_MIN_MS;
+        ssd1306_retry_tick = HAL_GetTick();
+    }
+}
+
+/********************** external functions definition ************************/
+void display_backend_init(uint8_t id, uint8_t bus_address)
+{
+    (void)id;
+
+    ssd1306_address = bus_address;
+    ssd1306_byte_time_us = (I2C_BITS_PER_BYTE * 1000000) / hi2c1.Init.ClockSpeed;
+    ssd1306_transfer_busy = false;
+    ssd1306_backlight_on = true;
+    ssd1306_display_on = false;
+    ssd1306_panel_on_sent = false;
+    ssd1306_cursor_on = false;
+    ssd1306_blink_on = false;
+    ssd1306_cursor_address = SSD1306_CURSOR_ADDRESS_NONE;
+    ssd1306_cursor_decoration = SSD1306_CURSOR_NONE;
+    memset(ssd1306_ddram, ' ', sizeof(ssd1306_ddram));
+    graphics_surface_init(&ssd1306_surface, ssd1306_pixels, SSD1306_WIDTH, SSD1306_PAGES * SSD1306_PAGE_ROWS);
+    graphics_fill(&ssd1306_surface, false);
+    graphics_dirty_clear(&ssd1306_surface);
+    memset(ssd1306_cell_character, ' ', sizeof(ssd1306_cell_character));
+    ssd1306_dirty_all();
+
+    ssd1306_bus_healthy = ssd1306_controller_init();
+    ssd1306_retry_ms = SSD1306_RETRY_MIN_MS;
+    ssd1306_retry_tick = HAL_GetTick();
+}
+
+void display_backend_update(void)
+{
+    if (ssd1306_transfer_is_expired())
+        ssd1306_bus_fault();
+
+    if (ssd1306_bus_healthy == false) {
+        if ((HAL_GetTick() - ssd1306_retry_tick) < ssd1306_retry_ms)
+            return;
+
+        /* The aborted transfer left the HAL busy and maybe the bus held */
+        if (display_i2c_bus_recover() == false || ssd1306_controller_init() == false) {
+            ssd1306_retry_tick = HAL_GetTick();
+            if (ssd1306_retry_ms < SSD1306_RETRY_MAX_MS)
+                ssd1306_retry_ms *= 2;
+            return;
+        }
+
+        /* The controller came back with its RAM and power state lost */
+        ssd1306_panel_on_sent = false;
+        ssd1306_dirty_all();
+        ssd1306_bus_healthy = true;
+    }
+
+    if (ssd1306_blink_on && (HAL_GetTick() - ssd1306_blink_tick) >= SSD1306_BLINK_MS) {
+        ssd1306_blink_tick = HAL_GetTick();
+        ssd1306_blink_phase = !ssd1306_blink_phase;
+        ssd1306_cursor_update();
+    }
+
+    ssd1306_push_next();
+}
+
+bool display_backend_is_healthy(void)
+{
+    return ssd1306_bus_healthy;
+}
+
+void display_backend_controller_select(uint8_t id, uint8_t controllers)
+{
+    /* A single emulated controller */
+    (void)id;
+    (void)controllers;
+}
+
+void display_backend_4_bits_mode_enter(uint8_t id)
+{
+    (void)id;
+}
+
+/* The HD44780 instruction stream is interpreted against an emulated DDRAM
+ * and CGRAM, and only the pixels it changes are pushed */
+void display_backend_code_send(uint8_t id, bool type, uint8_t data_bus)
+{
+    (void)id;
+
+    if (type == DISPLAY_RS_DATA) {
+        if (ssd1306_cgram_selected) {
+            ssd1306_cgram[ssd1306_cgram_address] = data_bus & 0x1F;
+            ssd1306_character_render(ssd1306_cgram_address / SSD1306_PAGE_ROWS);
+            ssd1306_cgram_address = (ssd1306_cgram_address + 1) % SSD1306_CGRAM_SIZE;
+            return;
+        }
+
+        ssd1306_ddram[ssd1306_address_counter] = data_bus;
+        ssd1306_cell_render(ssd1306_address_counter, false);
+        ssd1306_address_counter = ssd1306_address_next(ssd1306_address_counter);
+        ssd1306_cursor_update();
+        return;
+    }
+
+    if (data_bus & 0x80) {
+        ssd1306_address_counter = data_bus & 0x7F;
+        ssd1306_cgram_selected = false;
+    }
+    else if (data_bus & 0x40) {
+        ssd1306_cgram_address = data_bus & 0x3F;
+        ssd1306_cgram_selected = true;
+    }
+    else if (data_bus & 0x20) {
+        /* Function set, the interface width means nothing here */
+    }
+    else if (data_bus & 0x10) {
+        /* Cursor and display shift are not emulated */
+    }
+    else if (data_bus & 0x08) {
+        ssd1306_display_on = (data_bus & 0x04) != 0;
+        ssd1306_cursor_on = (data_bus & 0x02) != 0;
+        if (ssd1306_blink_on == false && (data_bus & 0x01)) {
+            ssd1306_blink_phase = true;
+            ssd1306_blink_tick = HAL_GetTick();
+        }
+        ssd1306_blink_on = (data_bus & 0x01) != 0;
+    }
+    else if (data_bus & 0x04) {
+        /* Entry mode, the text layer always increments */
+    }
+    else if (data_bus & 0x02) {
+        ssd1306_address_counter = 0;
+        ssd1306_cgram_selected = false;
+    }
+    else if (data_bus & 0x01) {
+        memset(ssd1306_ddram, ' ', sizeof(ssd1306_ddram));
+        for (uint8_t address = 0; address < SSD1306_DDRAM_SIZE; address++)
+            ssd1306_cell_render(address, false);
+        ssd1306_address_counter = 0;
+        ssd1306_cgram_selected = false;
+    }
+
+    ssd1306_cursor_update();
+}
+
+/* Bytes of the pixels the code would draw, a DDRAM write of a new
+ * character and the cursor moving with the address counter. Other codes
+ * cost nothing on the bus. */
+uint32_t display_backend_code_cost(uint8_t id, bool type, uint8_t data_bus)
+{
+    ssd1306_dirty_t dirty[SSD1306_PAGES];
+    uint32_t bytes_before, bytes_after;
+    uint8_t address, row, column;
+
+    (void)id;
+
+    memcpy(dirty, ssd1306_dirty, sizeof(dirty));
+    if (type == DISPLAY_RS_DATA && ssd1306_cgram_selected == false) {
+        if (ssd1306_cell_locate(ssd1306_address_counter, &row, &column) && ssd1306_cell_character[row][column] != data_bus)
+            ssd1306_cell_dirty_add(dirty, ssd1306_address_counter);
+        address = ssd1306_address_next(ssd1306_address_counter);
+    }
+    else if (type == DISPLAY_RS_INSTRUCTION && (data_bus & 0x80))
+        address = data_bus & 0x7F;
+    else
+        return 0;
+
+    if (ssd1306_cursor_address != SSD1306_CURSOR_ADDRESS_NONE && address != ssd1306_cursor_address) {
+        ssd1306_cell_dirty_add(dirty, ssd1306_cursor_address);
+        ssd1306_cell_dirty_add(dirty, address);
+    }
+
+    /* A cell can join two windows into one that costs less */
+    bytes_before = ssd1306_dirty_bytes(ssd1306_dirty);
+    bytes_after = ssd1306_dirty_bytes(dirty);
+    return (bytes_after > bytes_before) ? bytes_after - bytes_before : 0;
+}
+
+void display_backend_wait_us(uint8_t id, uint32_t wait_us)
+{
+    /* Instructions complete as they are interpreted */
+    (void)id;
+    (void)wait_us;
+}
+
+void display_backend_flush(uint8_t id)
+{
+    (void)id;
+
+    ssd1306_push_next();
+}
+
+bool display_backend_is_busy(uint8_t id)
+{
+    (void)id;
+
+    return false;
+}
+
+bool display_backend_address_counter_read(uint8_t id, uint8_t *p_address)
+{
+    (void)id;
+
+    if (ssd1306_cgram_selected)
+        return false;
+
+    *p_address = ssd1306_address_counter;
+    return true;
+}
+
+void display_backend_backlight_write(uint8_t id, bool on)
+{
+    (void)id;
+
+    /* No backlight, the panel is put to sleep instead */
+    ssd1306_backlight_on = on;
+    ssd1306_push_next();
+}
+
+void display_backend_refresh(uint8_t id)
+{
+    /* The controller keeps its state, there is nothing to re-assert */
+    (void)id;
+}
+
+void HAL_I2C_MemTxCpltCallback(I2C_HandleTypeDef *hi2c)
+{
+    if (hi2c->Instance != hi2c1.Instance)
+        return;
+
+    ssd1306_window_data_send();
+}
+
+void HAL_I2C_ErrorCallback(I2C_HandleTypeDef *hi2c)
+{
+    if (hi2c->Instance != hi2c1.Instance)
+        return;
+
+    /* NACK or bus error, the whole framebuffer is sent again once back */
+    ssd1306_bus_fault();
+}
+
+#endif /* DISPLAY_BACKEND == DISPLAY_BACKEND_SSD1306 */
+
+/********************** end of file ******************************************/
@@ -0,0 +1,374 @@
+/*
+ * Copyright (c) 2023 Juan Manuel Cruz <jcruz@fi.uba.ar> <jcruz@frba.utn.edu.ar>.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ * @file   : graphics.c
+ * @date   : Ago 14, 2024
+ * @author : Manuel Collazo <mcollazo@fi.uba.ar>
+ */
+
+/********************** inclusions *******************************************/
+#include <string.h>
+
+/* Project includes. */
+
+/* Demo includes. */
+
+/* Application & Tasks includes. */
+#include "graphics.h"
+
+/********************** macros and definitions *******************************/
+#define GRAPHICS_WORD_ALL  0xFFFFFFFFu
+#define GRAPHICS_PAGE_ROWS 8
+
+/********************** internal data declaration ****************************/
+
+/********************** internal functions declaration ***********************/
+static bool graphics_clip(const graphics_surface_t *p_surface, int16_t *p_x, int16_t *p_y, int16_t *p_width, int16_t *p_height);
+static void graphics_dirty_add(graphics_surface_t *p_surface, int16_t x, int16_t y, int16_t width, int16_t height);
+static void graphics_word_apply(uint32_t *p_word, uint32_t mask, uint32_t bits, graphics_op_t op);
+static uint32_t graphics_row_bits_get(const uint32_t *p_row, uint16_t stride, int32_t bit);
+static void graphics_transpose8(uint32_t *p_x, uint32_t *p_y);
+
+/********************** internal data definition *****************************/
+
+/********************** external data declaration ****************************/
+
+/********************** internal functions definition ************************/
+static bool graphics_clip(const graphics_surface_t *p_surface, int16_t *p_x, int16_t *p_y, int16_t *p_width, int16_t *p_height)
+{
+    if (*p_x < 0) {
+        *p_width += *p_x;
+        *p_x = 0;
+    }
+    if (*p_y < 0) {
+        *p_height += *p_y;
+        *p_y = 0;
+    }
+    if (*p_x + *p_width > p_surface->width)
+        *p_width = p_surface->width - *p_x;
+    if (*p_y + *p_height > p_surface->height)
+        *p_height = p_surface->height - *p_y;
+
+    return *p_width > 0 && *p_height > 0;
+}
+
+static void graphics_dirty_add(graphics_surface_t *p_surface, int16_t x, int16_t y, int16_t width, int16_t height)
+{
+    graphics_rect_t *p_dirty = &p_surface->dirty;
+    int16_t right, bottom;
+
+    if (p_dirty->width == 0) {
+        p_dirty->x = x;
+        p_dirty->y = y;
+        p_dirty->width = width;
+        p_dirty->height = height;
+        return;
+    }
+
+    right = (x + width > p_dirty->x + p_dirty->width) ? x + width : p_dirty->x + p_dirty->width;
+    bottom = (y + height > p_dirty->y + p_dirty->height) ? y + height : p_dirty->y + p_dirty->height;
+    if (p_dirty->x > x)
+        p_dirty->x = x;
+    if (p_dirty->y > y)
+        p_dirty->y = y;
+    p_dirty->width = right - p_dirty->x;
+    p_dirty->height = bottom - p_dirty->y;
+}
+
+static void graphics_word_apply(uint32_t *p_word, uint32_t mask, uint32_t bits, graphics_op_t op)
+{
+    switch (op) {
+        case GRAPHICS_OP_SET:
+            *p_word |= bits & mask;
+            break;
+        case GRAPHICS_OP_CLEAR:
+            *p_word &= ~(bits & mask);
+            break;
+        case GRAPHICS_OP_XOR:
+            *p_word ^= bits & mask;
+            break;
+        case GRAPHICS_OP_COPY:
+        default:
+            *p_word = (*p_word & ~mask) | (bits & mask);
+            break;
+    }
+}
+
+/* 32 pixels of a row starting at any bit, -31 included. Pixels outside the
+ * row read as clear. */
+static uint32_t graphics_row_bits_get(const uint32_t *p_row, uint16_t stride, int32_t bit)
+{
+    int32_t word = (bit < 0) ? -1 : bit / GRAPHICS_WORD_BITS;
+    uint32_t shift = (uint32_t)bit & (GRAPHICS_WORD_BITS - 1);
+    uint32_t low = (word >= 0 && word < stride) ? p_row[word] : 0;
+    uint32_t high;
+
+    if (shift == 0)
+        return low;
+
+    high = (word + 1 < stride) ? p_row[word + 1] : 0;
+    return (low >> shift) | (high << (GRAPHICS_WORD_BITS - shift));
+}
+
+/* 8x8 bit matrix transpose, Hacker's Delight 7-3. Row i is byte i of
+ * (*p_y, *p_x) from the low end, and so is column i on return. */
+static void graphics_transpose8(uint32_t *p_x, uint32_t *p_y)
+{
+    uint32_t x = *p_x, y = *p_y, t;
+
+    t = (x ^ (x >> 7)) & 0x00AA00AA;  x = x ^ t ^ (t << 7);
+    t = (y ^ (y >> 7)) & 0x00AA00AA;  y = y ^ t ^ (t << 7);
+    t = (x ^ (x >> 14)) & 0x0000CCCC; x = x ^ t ^ (t << 14);
+    t = (y ^ (y >> 14)) & 0x0000CCCC; y = y ^ t ^ (t << 14);
+    t = (x & 0xF0F0F0F0) | ((y >> 4) & 0x0F0F0F0F);
+    y = ((x << 4) & 0xF0F0F0F0) | (y & 0x0F0F0F0F);
+
+    *p_x = t;
+    *p_y = y;
+}
+
+/********************** external functions definition ************************/
+void graphics_surface_init(graphics_surface_t *p_surface, uint32_t *p_words, uint16_t width, uint16_t height)
+{
+    p_surface->p_words = p_words;
+    p_surface->width = width;
+    p_surface->height = height;
+    p_surface->stride = GRAPHICS_SURFACE_STRIDE(width);
+    graphics_fill(p_surface, false);
+}
+
+void graphics_fill(graphics_surface_t *p_surface, bool on)
+{
+    memset(p_surface->p_words, on ? 0xFF : 0x00, p_surface->stride * p_surface->height * sizeof(uint32_t));
+    graphics_dirty_clear(p_surface);
+    graphics_dirty_add(p_surface, 0, 0, p_surface->width, p_surface->height);
+}
+
+void graphics_rect_fill(graphics_surface_t *p_surface, int16_t x, int16_t y, int16_t width, int16_t height, graphics_op_t op)
+{
+    uint32_t first_mask, last_mask, *p_row;
+    uint16_t first_word, last_word, word;
+
+    if (graphics_clip(p_surface, &x, &y, &width, &height) == false)
+        return;
+    graphics_dirty_add(p_surface, x, y, width, height);
+
+    first_word = x / GRAPHICS_WORD_BITS;
+    last_word = (x + width - 1) / GRAPHICS_WORD_BITS;
+    first_mask = GRAPHICS_WORD_ALL << (x % GRAPHICS_WORD_BITS);
+    last_mask = GRAPHICS_WORD_ALL >> (GRAPHICS_WORD_BITS - 1 - (x + width - 1) % GRAPHICS_WORD_BITS);
+    if (first_word == last_word)
+        first_mask &= last_mask;
+
+    /* Whole words in the middle, masked ones at both ends */
+    for (p_row = &p_surface->p_words[y * p_surface->stride]; height > 0; height--, p_row += p_surface->stride) {
+        graphics_word_apply(&p_row[first_word], first_mask, GRAPHICS_WORD_ALL, op);
+        for (word = first_word + 1; word < last_word; word++)
+            graphics_word_apply(&p_row[word], GRAPHICS_WORD_ALL, GRAPHICS_WORD_ALL, op);
+        if (last_word != first_word)
+            graphics_word_apply(&p_row[last_word], last_mask, GRAPHICS_WORD_ALL, op);
+    }
+}
+
+void graphics_rect_draw(graphics_surface_t *p_surface, int16_t x, int16_t y, int16_t width, int16_t height, graphics_op_t op)
+{
+    if (width <= 0 || height <= 0)
+        return;
+
+    /* The sides skip the corners, so XOR does not cancel them */
+    graphics_hline(p_surface, x, y, width, op);
+    if (height > 1)
+        graphics_hline(p_surface, x, y + height - 1, width, op);
+    if (height > 2) {
+        graphics_vline(p_surface, x, y + 1, height - 2, op);
+        if (width > 1)
+            graphics_vline(p_surface, x + width - 1, y + 1, height - 2, op);
+    }
+}
+
+void graphics_hline(graphics_surface_t *p_surface, int16_t x, int16_t y, int16_t width, graphics_op_t op)
+{
+    graphics_rect_fill(p_surface, x, y, width, 1, op);
+}
+
+void graphics_vline(graphics_surface_t *p_surface, int16_t x, int16_t y, int16_t height, graphics_op_t op)
+{
+    graphics_rect_fill(p_surface, x, y, 1, height, op);
+}
+
+/* Copies the area of the source to x, y of the destination, 32 pixels at a
+ * time whatever the alignment of both. The area must not overlap the
+ * destination when both are the same surface. */
+void graphics_blit(graphics_surface_t *p_dst, int16_t x, int16_t y, const graphics_surface_t *p_src, const graphics_rect_t *p_area, graphics_op_t op)
+{
+    int16_t src_x = p_area->x, src_y = p_area->y, width = p_area->width, height = p_area->height;
+    uint32_t first_mask, last_mask, mask;
+    uint16_t first_word, last_word, word;
+    const uint32_t *p_src_row;
+    uint32_t *p_dst_row;
+    int32_t offset;
+
+    /* Clip against the source first, then move the clipped edges of the
+     * destination along */
+    if (src_x < 0) {
+        x -= src_x;
+        width += src_x;
+        src_x = 0;
+    }
+    if (src_y < 0) {
+        y -= src_y;
+        height += src_y;
+        src_y = 0;
+    }
+    if (src_x + width > p_src->width)
+        width = p_src->width - src_x;
+    if (src_y + height > p_src->height)
+        height = p_src->height - src_y;
+
+    if (x < 0) {
+        src_x -= x;
+    }
+    if (y < 0) {
+        src_y -= y;
+    }
+    if (graphics_clip(p_dst, &x, &y, &width, &height) == false)
+        return;
+    graphics_dirty_add(p_dst, x, y, width, height);
+
+    first_word = x / GRAPHICS_WORD_BITS;
+    last_word = (x + width - 1) / GRAPHICS_WORD_BITS;
+    first_mask = GRAPHICS_WORD_ALL << (x % GRAPHICS_WORD_BITS);
+    last_mask = GRAPHICS_WORD_ALL >> (GRAPHICS_WORD_BITS - 1 - (x + width - 1) % GRAPHICS_WORD_BITS);
+
+    /* Source bit landing on bit 0 of the first destination word */
+    offset = src_x - x % GRAPHICS_WORD_BITS;
+
+    p_dst_row = &p_dst->p_words[y * p_dst->stride];
+    p_src_row = &p_src->p_words[src_y * p_src->stride];
+    for (; height > 0; height--, p_dst_row += p_dst->stride, p_src_row += p_src->stride) {
+        for (word = first_word; word <= last_word; word++) {
+            mask = GRAPHICS_WORD_ALL;
+            if (word == first_word)
+                mask &= first_mask;
+            if (word == last_word)
+                mask &= last_mask;
+            graphics_word_apply(&p_dst_row[word], mask,
+                                graphics_row_bits_get(p_src_row, p_src->stride, offset + (word - first_word) * GRAPHICS_WORD_BITS), op);
+        }
+    }
+}
+
+/* Draws a glyph of up to 8 pixels wide, one byte per row with bit 0 on the
+ * left. A row lands in one word, or straddles two when unaligned. COPY also
+ * clears the background of the glyph box. */
+void graphics_glyph_draw(graphics_surface_t *p_surface, int16_t x, int16_t y, const uint8_t *p_rows, uint8_t width, uint8_t height, graphics_op_t op)
+{
+    int16_t clip_x = x, clip_y = y, clip_width = width, clip_height = height;
+    uint32_t box, bits, shift, *p_word;
+    uint8_t row;
+
+    if (width > 8 || graphics_clip(p_surface, &clip_x, &clip_y, &clip_width, &clip_height) == false)
+        return;
+    graphics_dirty_add(p_surface, clip_x, clip_y, clip_width, clip_height);
+
+    /* Pixels of the glyph that survive the clipping, in glyph coordinates */
+    box = ((1u << clip_width) - 1) << (clip_x - x);
+    shift = clip_x % GRAPHICS_WORD_BITS;
+
+    for (row = clip_y - y; row < clip_y - y + clip_height; row++) {
+        bits = (p_rows[row] & box) >> (clip_x - x);
+        p_word = &p_surface->p_words[(y + row) * p_surface->stride + clip_x / GRAPHICS_WORD_BITS];
+
+        graphics_word_apply(p_word, (box >> (clip_x - x)) << shift, bits << shift, op);
+        if (shift + clip_width > GRAPHICS_WORD_BITS)
+            graphics_word_apply(p_word + 1, (box >> (clip_x - x)) >> (GRAPHICS_WORD_BITS - shift), bits >> (GRAPHICS_WORD_BITS - shift), op);
+    }
+}
+
+bool graphics_pixel_get(const graphics_surface_t *p_surface, int16_t x, int16_t y)
+{
+    if (x < 0 || y < 0 || x >= p_surface->width || y >= p_surface->height)
+        return false;
+
+    return (p_surface->p_words[y * p_surface->stride + x / GRAPHICS_WORD_BITS] >> (x % GRAPHICS_WORD_BITS)) & 1;
+}
+
+bool graphics_dirty_get(const graphics_surface_t *p_surface, graphics_rect_t *p_rect)
+{
+    if (p_surface->dirty.width == 0)
+        return false;
+
+    *p_rect = p_surface->dirty;
+    return true;
+}
+
+void graphics_dirty_clear(graphics_surface_t *p_surface)
+{
+    memset(&p_surface->dirty, 0, sizeof(graphics_rect_t));
+}
+
+/* Packs 8 rows from page * 8 into one byte per column with bit 0 on top,
+ * the layout of SSD1306 style page memory. p_columns holds width bytes. */
+void graphics_page_pack(const graphics_surface_t *p_surface, uint8_t page, uint8_t *p_columns)
+{
+    const uint32_t *p_rows[GRAPHICS_PAGE_ROWS];
+    uint32_t x, y;
+    uint16_t word, column;
+    uint8_t row, lane, shift;
+
+    for (row = 0; row < GRAPHICS_PAGE_ROWS; row++) {
+        uint16_t surface_row = page * GRAPHICS_PAGE_ROWS + row;
+        p_rows[row] = (surface_row < p_surface->height) ? &p_surface->p_words[surface_row * p_surface->stride] : NULL;
+    }
+
+    /* Each byte lane of a word is 8 columns, transposed at once */
+    for (word = 0; word < p_surface->stride; word++) {
+        for (lane = 0; lane < sizeof(uint32_t); lane++) {
+            x = 0;
+            y = 0;
+            for (row = 0; row < GRAPHICS_PAGE_ROWS / 2; row++) {
+                shift = lane * 8;
+                if (p_rows[row] != NULL)
+                    y |= ((p_rows[row][word] >> shift) & 0xFF) << (row * 8);
+                if (p_rows[row + 4] != NULL)
+                    x |= ((p_rows[row + 4][word] >> shift) & 0xFF) << (row * 8);
+            }
+            graphics_transpose8(&x, &y);
+
+            column = word * GRAPHICS_WORD_BITS + lane * 8;
+            for (row = 0; row < 8 && column + row < p_surface->width; row++)
+                p_columns[column + row] = (row < 4) ? (uint8_t)(y >> (row * 8)) : (uint8_t)(x >> ((row - 4) * 8));
+        }
+    }
+}
+
+/********************** end of file ******************************************/
@@ -61,6 +61,7 @@
 /********************** internal data definition *****************************/
 
 /********************** external data declaration ****************************/
+unsigned int menu_label_generation;
 
 /********************** internal functions definition ************************/
 
@@ -69,6 +70,7 @@ void menu_initialize(menu_t* menu, menu_t* parent_menu, menu_item_t* items, int
     menu->items = items;
     menu->item_count = item_count;
     menu->current_item = 0;
+    menu->first_visible_item = 0;
     menu->parent_menu = parent_menu;
 }
 
@@ -107,13 +109,26 @@ char* menu_get_item_label(menu_t* menu, int index) {
     return menu->items[index].label;
 }
 
+/* Labels longer than the array are cut, a full array has no terminator */
+void menu_set_item_label(menu_t* menu, int index, const char* label) {
+    if (index < 0 || index >= menu->item_count) {
+        return;
+    }
+    strncpy(menu->items[index].label, label, MAX_LABEL_LENGTH);
+    menu_label_generation++;
+}
+
 void menu_initialize_default(menu_t* menu) {
     static menu_item_t default_items[DEFAULT_MENU_ITEM_COUNT];
     static menu_item_t sub_menu_items[DEFAULT_MENU_ITEM_COUNT][SUB_MENU_ITEM_COUNT];
     static menu_t sub_menus[DEFAULT_MENU_ITEM_COUNT];
     for (int i = 0; i < DEFAULT_MENU_ITEM_COUNT; i++) {
         for (int j = 0; j < SUB_MENU_ITEM_COUNT; j++) {
-            sprintf(sub_menu_items[i][j].label, "Submenu %d Item %d", i + 1, j + 1);
+            /* The last label overflows the 16 label columns of a 20 column row */
+            if (j == SUB_MENU_ITEM_COUNT - 1)
+                sprintf(sub_menu_items[i][j].label, "Submenu %d Settings", i + 1);
+            else
+                sprintf(sub_menu_items[i][j].label, "Submenu %d Item %d", i + 1, j + 1);
             sub_menu_items[i][j].sub_menu = NULL;
         }
         menu_initialize(&sub_menus[i], menu, sub_menu_items[i], SUB_MENU_ITEM_COUNT);
@@ -123,10 +138,26 @@ void menu_initialize_default(menu_t* menu) {
         default_items[i].sub_menu = &sub_menus[i];
     }
     menu_initialize(menu, NULL, default_items, DEFAULT_MENU_ITEM_COUNT);
+    menu_label_generation++;
 }
 
 int menu_get_current_item_index(menu_t* menu) {
 	return menu->current_item;
 }
 
+/* Scroll the window of visible items only as far as needed to keep the
+ * current item in it */
+void menu_viewport_update(menu_t* menu, int visible_rows) {
+    if (menu->current_item < menu->first_visible_item) {
+        menu->first_visible_item = menu->current_item;
+    }
+    else if (menu->current_item >= menu->first_visible_item + visible_rows) {
+        menu->first_visible_item = menu->current_item - visible_rows + 1;
+    }
+}
+
+int menu_get_first_visible_item(menu_t* menu) {
+	return menu->first_visible_item;
+}
+
 /********************** end of file ******************************************/
@@ -49,28 +49,159 @@
 /* Application & Tasks includes. */
 #include "board.h"
 #include "app.h"
+#include "task_screen.h"
 #include "task_screen_attribute.h"
 #include "task_screen_interface.h"
 #include "display.h"
+#include "menu.h"
 
 /********************** macros and definitions *******************************/
 #define G_TASK_ACT_CNT_INIT	0u
 
 #define DELAY_INI	0u
 
-#define SYSTEM_TIME_INCREMENT_MS   5
-#define DISPLAY_REFRESH_TIME_MS 50000
+/* At most one frame is drawn per interval, always the newest state */
+#ifndef DISPLAY_REFRESH_TIME_MS
+#define DISPLAY_REFRESH_TIME_MS 40
+#endif
 #define FIRST_COLUMN_NUMBER 0
 
+/* Labels start after the "[x] " marker */
+#define LABEL_COLUMN (FIRST_COLUMN_NUMBER + 4)
+#define LABEL_WIDTH  (LCD_DISPLAY_WIDTH - LABEL_COLUMN)
+
+/* A label that fills menu_item_t.label has no terminator */
+#define LABEL_LENGTH_MAX MAX_LABEL_LENGTH
+
+/* Show the selection with the blinking hardware cursor on the checkbox
+ * instead of redrawing the marker, one address command per move */
+#ifndef TASK_SCREEN_SELECTION_CURSOR
+#define TASK_SCREEN_SELECTION_CURSOR 0
+#endif
+
+/* Draw the selection checkbox with CGRAM glyphs instead of "[x] " */
+#ifndef TASK_SCREEN_MARKER_GLYPH
+#define TASK_SCREEN_MARKER_GLYPH 1
+#endif
+
+/* Scroll the selected label when it is longer than the row, rewriting
+ * only the label cells of that row at each step */
+#ifndef TASK_SCREEN_MARQUEE
+#define TASK_SCREEN_MARQUEE 0
+#endif
+#ifndef TASK_SCREEN_MARQUEE_STEP_MS
+#define TASK_SCREEN_MARQUEE_STEP_MS 300
+#endif
+/* Steps the label rests at each end */
+#define TASK_SCREEN_MARQUEE_HOLD_STEPS 4
+
+/* Bus bytes, or instruction times on GPIO, a frame may send per call to
+ * task_screen_update(). The rest of the frame is sent by the next calls.
+ * About one tick of bus time at 100 kHz, 0 sends whole frames at once.
+ * Budgets below DISPLAY_FLUSH_BUDGET_MIN, 10 on the PCF8574 and 42 on the
+ * SSD1306, are raised to it so that every call writes at least one
+ * character. */
+#ifndef TASK_SCREEN_FLUSH_BUDGET
+#define TASK_SCREEN_FLUSH_BUDGET 12
+#endif
+
+/* Keep formatted lines, keyed by label, label generation and selection,
+ * so that redrawing a page writes them instead of formatting every label
+ * again */
+#ifndef TASK_SCREEN_LINE_CACHE
+#define TASK_SCREEN_LINE_CACHE 1
+#endif
+/* Power of two */
+#define LINE_CACHE_ENTRIES_BITS 4
+#define LINE_CACHE_ENTRIES (1 << LINE_CACHE_ENTRIES_BITS)
+
 /********************** internal data declaration ****************************/
-task_screen_dta_t task_screen_dta = {{"Default 1", "Default 2", "Default 3", "Default 4"}, 0, false};
+task_screen_dta_t task_screen_dta = {{"Default 1", "Default 2",
+#if (LCD_DISPLAY_HEIGHT > 2)
+                                        "Default 3", "Default 4",
+#endif
+                                       }, 0, false};
 
 /********************** internal functions declaration ***********************/
 static void format_display_line(const char* input, char* output, bool is_selected);
-void change_display(const char* line_1, const char* line_2, const char* line_3, const char* line_4, int current_item_index);
+static void frame_render(task_screen_dta_t *p_task_screen_dta);
+static void frame_flush(void);
+#if (TASK_SCREEN_LINE_CACHE == 1)
+static const char * line_cache_get(const char *label, bool is_selected);
+#endif
+#if (TASK_SCREEN_MARQUEE == 1)
+static void label_window_write(int row, int offset);
+static void marquee_select(int row);
+static void marquee_update(void);
+#endif
+void change_display(char * const lines[LCD_DISPLAY_HEIGHT], int current_item_index);
 void update_selected(int current_item_index);
 
 /********************** internal data definition *****************************/
+#if (TASK_SCREEN_MARKER_GLYPH == 1)
+static const display_glyph_t marker_glyph_unchecked = {{
+	0b00000,
+	0b11111,
+	0b10001,
+	0b10001,
+	0b10001,
+	0b11111,
+	0b00000,
+	0b00000,
+}};
+
+static const display_glyph_t marker_glyph_checked = {{
+	0b00000,
+	0b11111,
+	0b11011,
+	0b10101,
+	0b11011,
+	0b11111,
+	0b00000,
+	0b00000,
+}};
+#endif
+
+/* Text marker, replaced by the glyphs when they fit in CGRAM */
+static char marker_open = '[';
+static char marker_close = ']';
+static char marker_checked = 'x';
+static char marker_unchecked = ' ';
+
+static bool row_has_item[LCD_DISPLAY_HEIGHT];
+
+static display_t *p_display;
+
+/* HAL ticks of the last frame and of the first state still waiting for
+ * one */
+static uint32_t frame_tick;
+static uint32_t frame_pending_tick;
+static bool frame_is_pending;
+static task_screen_frame_stats_t frame_stats;
+
+/* Part of the frame is still waiting for its share of the budget */
+static bool frame_flush_pending;
+
+#if (TASK_SCREEN_LINE_CACHE == 1)
+/* Labels live in the menu items, so a label address stands for its menu
+ * and item index. The generation tells whether the label was written
+ * since the line was formatted. */
+static struct {
+	const char *label;
+	unsigned int generation;
+	bool is_selected;
+	char line[LCD_DISPLAY_WIDTH + 1];
+} line_cache[LINE_CACHE_ENTRIES];
+#endif
+
+#if (TASK_SCREEN_MARQUEE == 1)
+static const char *row_label[LCD_DISPLAY_HEIGHT];
+static int marquee_row = -1;
+static int marquee_offset;
+static int marquee_hold;
+static uint32_t marquee_tick;
+#endif
+
 const char *p_task_screen 		= "Task Screen (Screen Modeling)";
 const char *p_task_screen_ 		= "Non-Blocking & Update By Time Code";
 
@@ -80,18 +211,18 @@ volatile uint32_t g_task_screen_tick;
 
 /********************** internal functions definition ************************/
 static void format_display_line(const char* input, char* output, bool is_selected) {
-	int input_len = strlen(input);
+	int input_len = strnlen(input, LABEL_LENGTH_MAX);
     if (input_len > 0) {
-        strncpy(output, "[ ] ", LCD_DISPLAY_WIDTH);
-        if (is_selected) {
-            output[1] = 'x';
+        output[0] = marker_open;
+        output[1] = (is_selected && TASK_SCREEN_SELECTION_CURSOR == 0) ? marker_checked : marker_unchecked;
+        output[2] = marker_close;
+        output[3] = ' ';
+        if (input_len > LABEL_WIDTH) {
+            input_len = LABEL_WIDTH;
         }
-        strncpy(output + 4, input, LCD_DISPLAY_WIDTH - 4);
-        int output_len = strlen(output);
-        if (output_len < LCD_DISPLAY_WIDTH) {
-            for (int i = output_len; i < LCD_DISPLAY_WIDTH; i++) {
-                output[i] = ' ';
-            }
+        memcpy(output + LABEL_COLUMN, input, input_len);
+        for (int i = LABEL_COLUMN + input_len; i < LCD_DISPLAY_WIDTH; i++) {
+            output[i] = ' ';
         }
     } else {
         for (int i = 0; i < LCD_DISPLAY_WIDTH; i++) {
@@ -101,31 +232,188 @@ static void format_display_line(const char* input, char* output, bool is_selecte
     output[LCD_DISPLAY_WIDTH] = '\0';
 }
 
-void change_display(const char* line_1, const char* line_2, const char* line_3, const char* line_4, int current_item_index) {
-    char lines_to_display[LCD_DISPLAY_HEIGHT][LCD_DISPLAY_WIDTH + 1];
-	format_display_line(line_1, lines_to_display[0], 0 == current_item_index);
-	format_display_line(line_2, lines_to_display[1], 1 == current_item_index);
-	format_display_line(line_3, lines_to_display[2], 2 == current_item_index);
-	format_display_line(line_4, lines_to_display[3], 3 == current_item_index);
+#if (TASK_SCREEN_MARQUEE == 1)
+static void label_window_write(int row, int offset) {
+	char window[LABEL_WIDTH + 1];
+	const char *label = row_label[row] + offset;
+	int length = (int)strnlen(row_label[row], LABEL_LENGTH_MAX) - offset;
+	int i;
+
+	for (i = 0; i < LABEL_WIDTH && i < length; i++)
+		window[i] = label[i];
+	for (; i < LABEL_WIDTH; i++)
+		window[i] = ' ';
+	window[LABEL_WIDTH] = '\0';
+
+	/* Only the cells that moved differ from the shadow */
+	display_frame_string_write(p_display, LABEL_COLUMN, row, window);
+}
+
+static void marquee_select(int row) {
+	/* The label that loses the selection goes back to its start */
+	if (marquee_row >= 0 && marquee_offset != 0)
+		label_window_write(marquee_row, 0);
+
+	marquee_row = -1;
+	if (row >= 0 && row < LCD_DISPLAY_HEIGHT && row_label[row] != NULL && strnlen(row_label[row], LABEL_LENGTH_MAX) > LABEL_WIDTH)
+		marquee_row = row;
+
+	marquee_offset = 0;
+	marquee_hold = TASK_SCREEN_MARQUEE_HOLD_STEPS;
+	marquee_tick = HAL_GetTick();
+}
+
+static void marquee_update(void) {
+	int offset_max;
+
+	if (marquee_row < 0 || (HAL_GetTick() - marquee_tick) < TASK_SCREEN_MARQUEE_STEP_MS)
+		return;
+	marquee_tick = HAL_GetTick();
+
+	if (marquee_hold > 0) {
+		marquee_hold--;
+		return;
+	}
+
+	/* Scroll to the end of the label, rest, then jump back to its start */
+	offset_max = (int)strnlen(row_label[marquee_row], LABEL_LENGTH_MAX) - LABEL_WIDTH;
+	if (marquee_offset < offset_max) {
+		marquee_offset++;
+	}
+	else {
+		marquee_offset = 0;
+	}
+	if (marquee_offset == 0 || marquee_offset == offset_max)
+		marquee_hold = TASK_SCREEN_MARQUEE_HOLD_STEPS;
+
+	label_window_write(marquee_row, marquee_offset);
+	frame_flush();
+}
+#endif
+
+static void frame_render(task_screen_dta_t *p_task_screen_dta)
+{
+	bool context_switch = false;
+
+	/* Older states still queued are out of date, only the newest one is
+	 * drawn. A context switch among them still needs the full redraw. */
+	*p_task_screen_dta = get_event_task_screen();
+	context_switch = p_task_screen_dta->context_switch;
+	while (true == any_event_task_screen())
+	{
+		*p_task_screen_dta = get_event_task_screen();
+		context_switch = context_switch || p_task_screen_dta->context_switch;
+		frame_stats.skipped++;
+	}
+
+	if (context_switch)
+	{
+		change_display(p_task_screen_dta->lines, p_task_screen_dta->selected);
+	}
+	else
+	{
+		update_selected(p_task_screen_dta->selected);
+	}
+
+	frame_stats.rendered++;
+	frame_tick = HAL_GetTick();
+	if ((frame_tick - frame_pending_tick) > DISPLAY_REFRESH_TIME_MS)
+		frame_stats.late++;
+	frame_is_pending = false;
+}
+
+#if (TASK_SCREEN_LINE_CACHE == 1)
+static const char * line_cache_get(const char *label, bool is_selected)
+{
+	/* Fibonacci hashing spreads the fixed stride between item labels */
+	uint32_t index = ((uint32_t)(uintptr_t)label * 2654435761u) >> (32 - LINE_CACHE_ENTRIES_BITS);
+
+	index = (index + is_selected) % LINE_CACHE_ENTRIES;
+	if (line_cache[index].label != label || line_cache[index].generation != menu_label_generation ||
+		line_cache[index].is_selected != is_selected)
+	{
+		format_display_line(label, line_cache[index].line, is_selected);
+		line_cache[index].label = label;
+		line_cache[index].generation = menu_label_generation;
+		line_cache[index].is_selected = is_selected;
+	}
+	return line_cache[index].line;
+}
+#endif
+
+static void frame_flush(void)
+{
+#if (TASK_SCREEN_FLUSH_BUDGET == 0)
+	display_frame_flush(p_display);
+#else
+	frame_flush_pending = true;
+#endif
+}
+
+void change_display(char * const lines[LCD_DISPLAY_HEIGHT], int current_item_index) {
+#if (TASK_SCREEN_LINE_CACHE == 0)
+    char line_to_display[LCD_DISPLAY_WIDTH + 1];
+#endif
 
     for (size_t i = 0; i < LCD_DISPLAY_HEIGHT; i++)
     {
-	    display_char_position_write (FIRST_COLUMN_NUMBER, i);
-	    display_string_write(lines_to_display[i]);
+	    /* Menus shorter than the panel leave the last rows without label */
+	    const char *line = (lines[i] != NULL) ? lines[i] : "";
+
+#if (TASK_SCREEN_LINE_CACHE == 1)
+	    display_frame_string_write(p_display, FIRST_COLUMN_NUMBER, i, line_cache_get(line, (int)i == current_item_index));
+#else
+	    format_display_line(line, line_to_display, (int)i == current_item_index);
+	    display_frame_string_write(p_display, FIRST_COLUMN_NUMBER, i, line_to_display);
+#endif
+	    row_has_item[i] = line[0] != '\0';
+#if (TASK_SCREEN_MARQUEE == 1)
+	    row_label[i] = line;
+#endif
     }
+#if (TASK_SCREEN_MARQUEE == 1)
+    /* The whole screen was just rewritten, nothing to restore */
+    marquee_row = -1;
+    marquee_select(current_item_index);
+#endif
+#if (TASK_SCREEN_SELECTION_CURSOR == 1)
+    display_cursor_show(p_display, FIRST_COLUMN_NUMBER + 1, current_item_index, true);
+#endif
+    frame_flush();
 }
 
 void update_selected(int current_item_index) {
+#if (TASK_SCREEN_MARQUEE == 1)
+	marquee_select(current_item_index);
+#endif
+#if (TASK_SCREEN_SELECTION_CURSOR == 1)
+	display_cursor_show(p_display, FIRST_COLUMN_NUMBER + 1, current_item_index, true);
+#if (TASK_SCREEN_MARQUEE == 1)
+	frame_flush();
+#endif
+#else
+	char unchecked[] = {marker_unchecked, '\0'};
+	char checked[] = {marker_checked, '\0'};
+
 	for (size_t i = 0; i < LCD_DISPLAY_HEIGHT; i++)
     {
-	    display_char_position_write (FIRST_COLUMN_NUMBER + 1, i);
-	    display_string_write(" ");
+	    /* Empty rows have no checkbox to clear */
+	    if (row_has_item[i])
+	    	display_frame_string_write(p_display, FIRST_COLUMN_NUMBER + 1, i, unchecked);
     }
-	display_char_position_write (FIRST_COLUMN_NUMBER + 1, current_item_index);
-	display_string_write("x");
+	display_frame_string_write(p_display, FIRST_COLUMN_NUMBER + 1, current_item_index, checked);
+	frame_flush();
+#endif
 }
 
 /********************** external functions definition ************************/
+void task_screen_line_cache_invalidate(void)
+{
+#if (TASK_SCREEN_LINE_CACHE == 1)
+	memset(line_cache, 0, sizeof(line_cache));
+#endif
+}
+
 void task_screen_init(void *parameters)
 {
 	/* Print out: Task Initialized */
@@ -138,7 +426,24 @@ void task_screen_init(void *parameters)
 	LOGGER_LOG("   %s = %d\r\n", GET_NAME(g_task_screen_cnt), (int)g_task_screen_cnt);
 
 	init_queue_event_task_screen();
-	display_init(DISPLAY_CONNECTION_I2C_PCF8574_IO_EXPANDER);
+	p_display = display_init(DISPLAY_ADDRESS_DEFAULT);
+
+#if (TASK_SCREEN_MARKER_GLYPH == 1)
+	char glyph_unchecked = display_glyph_acquire(p_display, &marker_glyph_unchecked);
+	char glyph_checked = display_glyph_acquire(p_display, &marker_glyph_checked);
+
+	if (glyph_unchecked != DISPLAY_GLYPH_NONE && glyph_checked != DISPLAY_GLYPH_NONE)
+	{
+		marker_open = ' ';
+		marker_close = ' ';
+		marker_unchecked = glyph_unchecked;
+		marker_checked = glyph_checked;
+		task_screen_line_cache_invalidate();
+	}
+#endif
+
+	/* The first state is drawn as soon as it comes */
+	frame_tick = HAL_GetTick() - DISPLAY_REFRESH_TIME_MS;
 
 	g_task_screen_tick = DELAY_INI;
 }
@@ -147,24 +452,26 @@ void task_screen_update(void *parameters)
 {
 	task_screen_dta_t *p_task_screen_dta;
 	bool b_time_update_required = false;
+	bool b_time_elapsed;
 
 	/* Update Task Screen Counter */
 	g_task_screen_cnt++;
 
 	/* Protect shared resource (g_task_screen_tick) */
 	__asm("CPSID i");	/* disable interrupts*/
-    if (DELAY_INI < g_task_screen_tick && true)
+    if (DELAY_INI < g_task_screen_tick)
     {
     	g_task_screen_tick--;
     	b_time_update_required = true;
     }
     __asm("CPSIE i");	/* enable interrupts*/
+    b_time_elapsed = b_time_update_required;
 
     while (b_time_update_required)
     {
 		/* Protect shared resource (g_task_screen_tick) */
 		__asm("CPSID i");	/* disable interrupts*/
-		if (DELAY_INI < g_task_screen_tick && false)
+		if (DELAY_INI < g_task_screen_tick)
 		{
 			g_task_screen_tick--;
 			b_time_update_required = true;
@@ -175,33 +482,43 @@ void task_screen_update(void *parameters)
 		}
 		__asm("CPSIE i");	/* enable interrupts*/
 
+		/* Advance the display power-up sequence, if still running */
+		display_update();
+
 		/* Update Task Screen Data Pointer */
 		p_task_screen_dta = &task_screen_dta;
 
 		if (true == any_event_task_screen())
 		{
-			*p_task_screen_dta = get_event_task_screen();
-
-			if (p_task_screen_dta->context_switch)
+			if (frame_is_pending == false)
 			{
-				change_display(
-					p_task_screen_dta->lines[0],
-					p_task_screen_dta->lines[1],
-					p_task_screen_dta->lines[2],
-					p_task_screen_dta->lines[3],
-					p_task_screen_dta->selected
-				);
-			}
-			else
-			{
-				update_selected(p_task_screen_dta->selected);
+				frame_is_pending = true;
+				frame_pending_tick = HAL_GetTick();
 			}
+
+			/* Held back until the interval since the last frame is over */
+			if ((HAL_GetTick() - frame_tick) >= DISPLAY_REFRESH_TIME_MS)
+				frame_render(p_task_screen_dta);
 		}
 		else
 		{
 			keep_alive();
+#if (TASK_SCREEN_MARQUEE == 1)
+			marquee_update();
+#endif
 		}
     }
+
+    /* One share of the pending frame per call, however many ticks were
+     * caught up, so a full redraw never holds the superloop for long */
+    if (b_time_elapsed && frame_flush_pending)
+    	frame_flush_pending = !display_frame_flush_budget(p_display, TASK_SCREEN_FLUSH_BUDGET);
+}
+
+void task_screen_frame_stats_get(task_screen_frame_stats_t *p_stats)
+{
+	*p_stats = frame_stats;
+	p_stats->skipped += superseded_events_task_screen();
 }
 
 /********************** end of file ******************************************/
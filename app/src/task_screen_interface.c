@@ -52,11 +52,26 @@
 /********************** macros and definitions *******************************/
 #define MAX_EVENTS		(16)
 
+/* Keep only the newest screen state instead of every intermediate one.
+ * A pending context switch is kept when later updates are merged in, so
+ * the merged frame is still fully redrawn. */
+#ifndef TASK_SCREEN_EVENT_COALESCE
+#define TASK_SCREEN_EVENT_COALESCE 1
+#endif
+
 /********************** internal data declaration ****************************/
 
 /********************** internal functions declaration ***********************/
 
 /********************** internal data definition *****************************/
+#if (TASK_SCREEN_EVENT_COALESCE == 1)
+struct
+{
+	bool	full;
+	task_screen_dta_t	dta;
+	uint32_t	superseded;
+} mailbox_task_screen;
+#else
 struct
 {
 	uint32_t	head;
@@ -64,11 +79,54 @@ struct
 	uint32_t	count;
 	task_screen_dta_t	queue[MAX_EVENTS];
 } queue_task_screen;
+#endif
 
 
 /********************** external data declaration ****************************/
 
 /********************** external functions definition ************************/
+#if (TASK_SCREEN_EVENT_COALESCE == 1)
+void init_queue_event_task_screen(void)
+{
+	mailbox_task_screen.full = false;
+	mailbox_task_screen.superseded = 0;
+}
+
+void put_event_task_screen(const task_screen_dta_t task_screen_dta)
+{
+	bool context_switch = task_screen_dta.context_switch;
+
+	if (mailbox_task_screen.full) {
+		context_switch = context_switch || mailbox_task_screen.dta.context_switch;
+		mailbox_task_screen.superseded++;
+	}
+
+	mailbox_task_screen.dta = task_screen_dta;
+	mailbox_task_screen.dta.context_switch = context_switch;
+	mailbox_task_screen.full = true;
+}
+
+task_screen_dta_t get_event_task_screen(void)
+{
+	task_screen_dta_t dta = {0};
+
+	if (mailbox_task_screen.full) {
+		dta = mailbox_task_screen.dta;
+		mailbox_task_screen.full = false;
+	}
+	return dta;
+}
+
+bool any_event_task_screen(void)
+{
+	return mailbox_task_screen.full;
+}
+
+uint32_t superseded_events_task_screen(void)
+{
+	return mailbox_task_screen.superseded;
+}
+#else
 void init_queue_event_task_screen(void)
 {
 	queue_task_screen.head = 0;
@@ -103,4 +161,11 @@ bool any_event_task_screen(void)
     return queue_task_screen.count > 0;
 }
 
+uint32_t superseded_events_task_screen(void)
+{
+	/* Nothing is merged, every event stays in the queue */
+	return 0;
+}
+#endif
+
 /********************** end of file ******************************************/
@@ -90,12 +90,21 @@ volatile uint32_t g_task_system_tick;
 task_screen_dta_t build_screen_dta_from_menu(menu_t* menu, bool context_switch)
 {
 	int i;
+	int first_visible_item = menu_get_first_visible_item(menu);
 	task_screen_dta_t task_screen;
+
+	/* A window that scrolled is sent as a full frame, the screen task
+	 * rewrites it through the frame shadow so only changed cells go out */
+	menu_viewport_update(menu, LCD_DISPLAY_HEIGHT);
+	if (menu_get_first_visible_item(menu) != first_visible_item)
+		context_switch = true;
+	first_visible_item = menu_get_first_visible_item(menu);
+
 	for (i = 0; i < LCD_DISPLAY_HEIGHT; i++)
 	{
-		task_screen.lines[i] = menu_get_item_label(current_menu, i);
+		task_screen.lines[i] = menu_get_item_label(menu, first_visible_item + i);
 	}
-	task_screen.selected = menu_get_current_item_index(current_menu);
+	task_screen.selected = menu_get_current_item_index(menu) - first_visible_item;
 	task_screen.context_switch = context_switch;
 	return task_screen;
 }
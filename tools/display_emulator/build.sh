@@ -0,0 +1,44 @@
+#!/bin/sh
+# Builds the display code against the host emulator and runs its checks.
+#
+# usage: tools/display_emulator/build.sh [pcf8574|ssd1306] [gcc flags...]
+#
+# Extra flags override the build options, e.g. -DDISPLAY_GEOMETRY=3 or
+# -DEMULATOR_FLUSH_BUDGET=6. The register-level I2C1 path,
+# DISPLAY_PCF8574_I2C_LL, is not emulated. Linux only: the peripherals the
+# display code reaches through fixed addresses are mapped with mmap().
+
+set -e
+
+ROOT=$(cd "$(dirname "$0")/../.." && pwd)
+EMULATOR="$ROOT/tools/display_emulator"
+OUTPUT="${TMPDIR:-/tmp}/display_emulator"
+
+case "${1:-pcf8574}" in
+    pcf8574) BACKEND=DISPLAY_BACKEND_PCF8574 ;;
+    ssd1306) BACKEND=DISPLAY_BACKEND_SSD1306 ;;
+    *) echo "usage: $0 [pcf8574|ssd1306] [gcc flags...]" >&2; exit 1 ;;
+esac
+[ $# -gt 0 ] && shift
+
+# __asm("CPSID i") and __asm("CPSIE i") hold off the emulated DMA
+# interrupts. Register addresses are 32 bits wide on the target only.
+gcc -std=gnu11 -O1 -g -Wall -Wno-unused-function -Wno-pointer-to-int-cast -Wno-int-to-pointer-cast -no-pie -pthread \
+    -DSTM32F103xB -DUSE_HAL_DRIVER "-DDISPLAY_BACKEND=($BACKEND)" '-D__asm(x)=emulator_interrupts(x)' -include "$EMULATOR/emulator.h" \
+    "$@" \
+    -I"$ROOT/Core/Inc" -I"$ROOT/app/inc" -I"$EMULATOR" \
+    -isystem "$ROOT/Drivers/STM32F1xx_HAL_Driver/Inc" \
+    -isystem "$ROOT/Drivers/CMSIS/Device/ST/STM32F1xx/Include" \
+    -isystem "$ROOT/Drivers/CMSIS/Include" \
+    "$ROOT/app/src/display.c" \
+    "$ROOT/app/src/display_pcf8574.c" \
+    "$ROOT/app/src/display_ssd1306.c" \
+    "$ROOT/app/src/display_i2c.c" \
+    "$ROOT/app/src/graphics.c" \
+    "$EMULATOR/emulator_hal.c" \
+    "$EMULATOR/emulator_hd44780.c" \
+    "$EMULATOR/emulator_ssd1306.c" \
+    "$EMULATOR/emulator_main.c" \
+    -o "$OUTPUT"
+
+"$OUTPUT"
@@ -0,0 +1,131 @@
+/*
+ * Copyright (c) 2023 Juan Manuel Cruz <jcruz@fi.uba.ar> <jcruz@frba.utn.edu.ar>.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ * @file   : emulator.h
+ * @date   : Ago 14, 2024
+ * @author : Manuel Collazo <mcollazo@fi.uba.ar>
+ * @version	v1.0.0
+ */
+
+#ifndef _EMULATOR_H_
+#define _EMULATOR_H_
+
+/********************** CPP guard ********************************************/
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/********************** inclusions *******************************************/
+#include <stdint.h>
+#include <stdbool.h>
+
+/********************** macros ***********************************************/
+#define EMULATOR_HD44780_DDRAM_SIZE 128
+#define EMULATOR_HD44780_CGRAM_SIZE 64
+#define EMULATOR_HD44780_CONTROLLERS 2
+
+#define EMULATOR_SSD1306_PAGES 8
+#define EMULATOR_SSD1306_WIDTH 128
+
+/********************** typedef **********************************************/
+/* Traffic seen on the emulated I2C bus. Bytes are the ones after the
+ * address byte, the SSD1306 control byte included, as counted by the
+ * DISPLAY_BACKEND_*_COST figures. */
+typedef struct {
+    uint32_t transfers;
+    uint32_t bytes;
+    uint32_t transfer_bytes_max;
+} emulator_bus_stats_t;
+
+typedef struct {
+    uint8_t ddram[EMULATOR_HD44780_DDRAM_SIZE];
+    uint8_t cgram[EMULATOR_HD44780_CGRAM_SIZE];
+    uint8_t address_counter;
+    bool cgram_selected;
+    bool interface_4_bits;
+    bool nibble_pending;
+    uint8_t nibble_high;
+    uint8_t display_control;
+} emulator_hd44780_t;
+
+typedef struct {
+    uint8_t ram[EMULATOR_SSD1306_PAGES][EMULATOR_SSD1306_WIDTH];
+    bool display_on;
+    uint8_t column_first;
+    uint8_t column_last;
+    uint8_t page_first;
+    uint8_t page_last;
+    uint8_t column;
+    uint8_t page;
+} emulator_ssd1306_t;
+
+/********************** external data declaration ****************************/
+extern emulator_bus_stats_t emulator_bus_stats;
+extern emulator_hd44780_t emulator_hd44780[EMULATOR_HD44780_CONTROLLERS];
+extern emulator_ssd1306_t emulator_ssd1306;
+
+/* Every transfer fails with a NACK while set */
+extern bool emulator_bus_is_failing;
+
+/* Number of times the I2C peripheral was initialised again */
+extern uint32_t emulator_bus_recoveries;
+
+/* DMA transfers complete from the core thread after their bus time,
+ * instead of before the HAL call returns */
+extern bool emulator_dma_is_deferred;
+
+/********************** external functions declaration ***********************/
+/* emulator_hal.c */
+void emulator_init(void);
+void emulator_tick_advance(uint32_t ms);
+void emulator_bus_stats_clear(void);
+bool emulator_dma_is_busy(void);
+
+/* The display code's __asm("CPSID i") and __asm("CPSIE i") end up here, an
+ * interrupt never runs between them */
+void emulator_interrupts(const char *p_instruction);
+
+/* emulator_hd44780.c, fed with every byte written to the PCF8574 */
+void emulator_hd44780_reset(void);
+void emulator_pcf8574_write(uint8_t port);
+uint8_t emulator_pcf8574_read(void);
+
+/* emulator_ssd1306.c, fed with every control byte and payload */
+void emulator_ssd1306_reset(void);
+void emulator_ssd1306_write(uint8_t control, const uint8_t *p_data, uint16_t length);
+
+/********************** End of CPP guard *************************************/
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _EMULATOR_H_ */
@@ -0,0 +1,424 @@
+/*
+ * Copyright (c) 2023 Juan Manuel Cruz <jcruz@fi.uba.ar> <jcruz@frba.utn.edu.ar>.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ * @file   : emulator_hal.c
+ * @date   : Ago 14, 2024
+ * @author : Manuel Collazo <mcollazo@fi.uba.ar>
+ * @version	v1.0.0
+ */
+
+/********************** inclusions *******************************************/
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+
+/* Project includes. */
+#include "main.h"
+
+/* Application & Tasks includes. */
+#include "emulator.h"
+
+/********************** macros and definitions *******************************/
+/* The display code reaches DWT and RCC through their fixed addresses, RAM
+ * is mapped there. The binary is linked with -no-pie to keep them free. */
+#define EMULATOR_PERIPHERAL_BASE 0x40000000UL
+#define EMULATOR_PERIPHERAL_SIZE 0x00030000UL
+#define EMULATOR_CORE_BASE       0xE0000000UL
+#define EMULATOR_CORE_SIZE       0x00100000UL
+
+#define EMULATOR_CORE_CLOCK_HZ 64000000UL
+#define EMULATOR_I2C_CLOCK_HZ    100000UL
+
+/* Deferred DMA transfers last their bus time, one address byte included */
+#define EMULATOR_I2C_BITS_PER_BYTE 9
+
+typedef enum {
+    EMULATOR_TRANSFER_PCF8574,
+    EMULATOR_TRANSFER_SSD1306,
+} emulator_transfer_kind_t;
+
+/* The DMA transfer on the bus. Its bytes reach the device model when it
+ * completes, so a buffer changed while in flight shows on the panel. */
+typedef struct {
+    volatile bool is_pending;
+    emulator_transfer_kind_t kind;
+    I2C_HandleTypeDef *p_hi2c;
+    uint8_t control;
+    const uint8_t *p_data;
+    uint16_t length;
+    uint64_t done_cycles;
+} emulator_transfer_t;
+
+/********************** internal data declaration ****************************/
+static uint32_t emulator_tick_offset;
+static uint64_t emulator_start_ns;
+static volatile uint64_t emulator_cycles;
+static emulator_transfer_t emulator_transfer;
+
+/* Held by the main thread between CPSID and CPSIE, and by the core
+ * thread while a completion callback runs */
+static pthread_mutex_t emulator_interrupt_lock;
+static __thread bool emulator_interrupts_are_disabled;
+
+/********************** internal functions declaration ***********************/
+static uint64_t emulator_time_ns(void);
+static void *emulator_core_run(void *p_argument);
+static void emulator_transfer_poll(void);
+static HAL_StatusTypeDef emulator_transfer_defer(emulator_transfer_kind_t kind, I2C_HandleTypeDef *p_hi2c, uint8_t control, const uint8_t *p_data, uint16_t length);
+static void emulator_transfer_count(uint16_t length);
+static void emulator_transfer_complete(void);
+
+/********************** internal data definition *****************************/
+
+/********************** external data definition *****************************/
+I2C_HandleTypeDef hi2c1;
+DMA_HandleTypeDef hdma_i2c1_tx;
+uint32_t SystemCoreClock = EMULATOR_CORE_CLOCK_HZ;
+
+emulator_bus_stats_t emulator_bus_stats;
+bool emulator_bus_is_failing;
+uint32_t emulator_bus_recoveries;
+bool emulator_dma_is_deferred;
+
+/********************** internal functions definition ************************/
+static uint64_t emulator_time_ns(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+/* CYCCNT follows the host clock at the core frequency, and a deferred
+ * transfer completes from here, as from the DMA interrupt. While the main
+ * thread has interrupts disabled, CYCCNT stops at the completion time and
+ * CPSIE takes the interrupt, so the code never sees a transfer outlast its
+ * bus time only because the host did not schedule this thread. */
+static void *emulator_core_run(void *p_argument)
+{
+    uint64_t now;
+
+    (void)p_argument;
+
+    for (;;) {
+        now = (emulator_time_ns() - emulator_start_ns) * (EMULATOR_CORE_CLOCK_HZ / 1000000UL) / 1000UL;
+        if (emulator_transfer.is_pending && now >= emulator_transfer.done_cycles) {
+            if (pthread_mutex_trylock(&emulator_interrupt_lock) == 0) {
+                emulator_transfer_poll();
+                pthread_mutex_unlock(&emulator_interrupt_lock);
+            }
+            else
+                now = emulator_transfer.done_cycles;
+        }
+        emulator_cycles = now;
+        DWT->CYCCNT = (uint32_t)now;
+        sched_yield();
+    }
+    return NULL;
+}
+
+/* Called with the interrupt lock held */
+static void emulator_transfer_poll(void)
+{
+    uint64_t now = (emulator_time_ns() - emulator_start_ns) * (EMULATOR_CORE_CLOCK_HZ / 1000000UL) / 1000UL;
+
+    if (emulator_transfer.is_pending && now >= emulator_transfer.done_cycles)
+        emulator_transfer_complete();
+}
+
+static void emulator_transfer_complete(void)
+{
+    uint16_t i;
+
+    emulator_transfer.is_pending = false;
+    if (emulator_transfer.kind == EMULATOR_TRANSFER_SSD1306) {
+        emulator_ssd1306_write(emulator_transfer.control, emulator_transfer.p_data, emulator_transfer.length);
+        HAL_I2C_MemTxCpltCallback(emulator_transfer.p_hi2c);
+    }
+    else {
+        for (i = 0; i < emulator_transfer.length; i++)
+            emulator_pcf8574_write(emulator_transfer.p_data[i]);
+        HAL_I2C_MasterTxCpltCallback(emulator_transfer.p_hi2c);
+    }
+}
+
+/* Starts a transfer that completes after its bus time, or fails at once
+ * like the HAL does when the bus is busy */
+static HAL_StatusTypeDef emulator_transfer_defer(emulator_transfer_kind_t kind, I2C_HandleTypeDef *p_hi2c, uint8_t control, const uint8_t *p_data, uint16_t length)
+{
+    if (emulator_bus_is_failing || emulator_transfer.is_pending)
+        return HAL_ERROR;
+
+    emulator_transfer_count(length);
+    emulator_transfer.kind = kind;
+    emulator_transfer.p_hi2c = p_hi2c;
+    emulator_transfer.control = control;
+    emulator_transfer.p_data = p_data;
+    emulator_transfer.length = (kind == EMULATOR_TRANSFER_SSD1306) ? length - 1 : length;
+    /* Counted from CYCCNT as the code read it for its own deadline, which
+     * lags the host clock until the core thread runs again */
+    emulator_transfer.done_cycles = emulator_cycles +
+        (uint64_t)(length + 1) * EMULATOR_I2C_BITS_PER_BYTE * EMULATOR_CORE_CLOCK_HZ / EMULATOR_I2C_CLOCK_HZ;
+    __sync_synchronize();
+    emulator_transfer.is_pending = true;
+    return HAL_OK;
+}
+
+static void emulator_transfer_count(uint16_t length)
+{
+    emulator_bus_stats.transfers++;
+    emulator_bus_stats.bytes += length;
+    if (emulator_bus_stats.transfer_bytes_max < length)
+        emulator_bus_stats.transfer_bytes_max = length;
+}
+
+/********************** external functions definition ************************/
+void emulator_init(void)
+{
+    pthread_t thread;
+    pthread_mutexattr_t attributes;
+
+    if (mmap((void *)EMULATOR_PERIPHERAL_BASE, EMULATOR_PERIPHERAL_SIZE, PROT_READ | PROT_WRITE,
+             MAP_FIXED | MAP_PRIVATE | MAP_ANONYMOUS, -1, 0) == MAP_FAILED ||
+        mmap((void *)EMULATOR_CORE_BASE, EMULATOR_CORE_SIZE, PROT_READ | PROT_WRITE,
+             MAP_FIXED | MAP_PRIVATE | MAP_ANONYMOUS, -1, 0) == MAP_FAILED) {
+        perror("mmap");
+        exit(EXIT_FAILURE);
+    }
+
+    hi2c1.Instance = I2C1;
+    hi2c1.Init.ClockSpeed = EMULATOR_I2C_CLOCK_HZ;
+    hi2c1.hdmatx = &hdma_i2c1_tx;
+
+    emulator_hd44780_reset();
+    emulator_ssd1306_reset();
+
+    pthread_mutexattr_init(&attributes);
+    pthread_mutexattr_settype(&attributes, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&emulator_interrupt_lock, &attributes);
+
+    emulator_start_ns = emulator_time_ns();
+    pthread_create(&thread, NULL, emulator_core_run, NULL);
+    while (DWT->CYCCNT == 0) {
+    }
+}
+
+void emulator_tick_advance(uint32_t ms)
+{
+    emulator_tick_offset += ms;
+}
+
+void emulator_interrupts(const char *p_instruction)
+{
+    bool disable = strcmp(p_instruction, "CPSID i") == 0;
+
+    if (disable && emulator_interrupts_are_disabled == false) {
+        pthread_mutex_lock(&emulator_interrupt_lock);
+        emulator_interrupts_are_disabled = true;
+    }
+    else if (disable == false && emulator_interrupts_are_disabled) {
+        emulator_interrupts_are_disabled = false;
+        emulator_transfer_poll();
+        pthread_mutex_unlock(&emulator_interrupt_lock);
+    }
+}
+
+bool emulator_dma_is_busy(void)
+{
+    return emulator_transfer.is_pending;
+}
+
+void emulator_bus_stats_clear(void)
+{
+    emulator_bus_stats.transfers = 0;
+    emulator_bus_stats.bytes = 0;
+    emulator_bus_stats.transfer_bytes_max = 0;
+}
+
+/* HAL, as far as the display code uses it. Unless emulator_dma_is_deferred
+ * is set, DMA transfers complete at once and the completion callbacks run
+ * before the call returns, as if the DMA interrupt had fired right away. */
+uint32_t HAL_GetTick(void)
+{
+    return (uint32_t)(emulator_time_ns() / 1000000ULL) + emulator_tick_offset;
+}
+
+void HAL_GPIO_Init(GPIO_TypeDef *GPIOx, GPIO_InitTypeDef *GPIO_Init)
+{
+    (void)GPIOx;
+    (void)GPIO_Init;
+}
+
+void HAL_GPIO_WritePin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin, GPIO_PinState PinState)
+{
+    (void)GPIOx;
+    (void)GPIO_Pin;
+    (void)PinState;
+}
+
+/* Nothing ever holds SDA low */
+GPIO_PinState HAL_GPIO_ReadPin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin)
+{
+    (void)GPIOx;
+    (void)GPIO_Pin;
+    return GPIO_PIN_SET;
+}
+
+HAL_StatusTypeDef HAL_DMA_Abort(DMA_HandleTypeDef *hdma)
+{
+    (void)hdma;
+    emulator_transfer.is_pending = false;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_I2C_DeInit(I2C_HandleTypeDef *hi2c)
+{
+    hi2c->State = HAL_I2C_STATE_RESET;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_I2C_Init(I2C_HandleTypeDef *hi2c)
+{
+    hi2c->State = HAL_I2C_STATE_READY;
+    emulator_bus_recoveries++;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_I2C_IsDeviceReady(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint32_t Trials, uint32_t Timeout)
+{
+    (void)hi2c;
+    (void)DevAddress;
+    (void)Trials;
+    (void)Timeout;
+    return emulator_bus_is_failing ? HAL_ERROR : HAL_OK;
+}
+
+__weak void HAL_I2C_MasterTxCpltCallback(I2C_HandleTypeDef *hi2c)
+{
+    (void)hi2c;
+}
+
+__weak void HAL_I2C_MemTxCpltCallback(I2C_HandleTypeDef *hi2c)
+{
+    (void)hi2c;
+}
+
+__weak void HAL_I2C_ErrorCallback(I2C_HandleTypeDef *hi2c)
+{
+    (void)hi2c;
+}
+
+/* PCF8574, every byte is a new port value */
+HAL_StatusTypeDef HAL_I2C_Master_Transmit(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint8_t *pData, uint16_t Size, uint32_t Timeout)
+{
+    uint16_t i;
+
+    (void)hi2c;
+    (void)DevAddress;
+    (void)Timeout;
+
+    if (emulator_bus_is_failing)
+        return HAL_ERROR;
+
+    emulator_transfer_count(Size);
+    for (i = 0; i < Size; i++)
+        emulator_pcf8574_write(pData[i]);
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_I2C_Master_Transmit_DMA(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint8_t *pData, uint16_t Size)
+{
+    if (emulator_dma_is_deferred)
+        return emulator_transfer_defer(EMULATOR_TRANSFER_PCF8574, hi2c, 0, pData, Size);
+
+    if (HAL_I2C_Master_Transmit(hi2c, DevAddress, pData, Size, 0) != HAL_OK)
+        return HAL_ERROR;
+
+    HAL_I2C_MasterTxCpltCallback(hi2c);
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_I2C_Master_Receive(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint8_t *pData, uint16_t Size, uint32_t Timeout)
+{
+    uint16_t i;
+
+    (void)hi2c;
+    (void)DevAddress;
+    (void)Timeout;
+
+    if (emulator_bus_is_failing)
+        return HAL_ERROR;
+
+    emulator_transfer_count(Size);
+    for (i = 0; i < Size; i++)
+        pData[i] = emulator_pcf8574_read();
+    return HAL_OK;
+}
+
+/* SSD1306, the memory address is the control byte */
+HAL_StatusTypeDef HAL_I2C_Mem_Write(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint16_t MemAddress, uint16_t MemAddSize, uint8_t *pData, uint16_t Size, uint32_t Timeout)
+{
+    (void)hi2c;
+    (void)DevAddress;
+    (void)MemAddSize;
+    (void)Timeout;
+
+    if (emulator_bus_is_failing)
+        return HAL_ERROR;
+
+    emulator_transfer_count(Size + 1);
+    emulator_ssd1306_write((uint8_t)MemAddress, pData, Size);
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_I2C_Mem_Write_DMA(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint16_t MemAddress, uint16_t MemAddSize, uint8_t *pData, uint16_t Size)
+{
+    (void)DevAddress;
+    (void)MemAddSize;
+
+    if (emulator_dma_is_deferred)
+        return emulator_transfer_defer(EMULATOR_TRANSFER_SSD1306, hi2c, (uint8_t)MemAddress, pData, Size + 1);
+
+    if (HAL_I2C_Mem_Write(hi2c, DevAddress, MemAddress, MemAddSize, pData, Size, 0) != HAL_OK)
+        return HAL_ERROR;
+
+    HAL_I2C_MemTxCpltCallback(hi2c);
+    return HAL_OK;
+}
+
+/********************** end of file ******************************************/
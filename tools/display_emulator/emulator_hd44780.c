@@ -0,0 +1,193 @@
+/*
+ * Copyright (c) 2023 Juan Manuel Cruz <jcruz@fi.uba.ar> <jcruz@frba.utn.edu.ar>.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ * @file   : emulator_hd44780.c
+ * @date   : Ago 14, 2024
+ * @author : Manuel Collazo <mcollazo@fi.uba.ar>
+ * @version	v1.0.0
+ */
+
+/********************** inclusions *******************************************/
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+/* Application & Tasks includes. */
+#include "display.h"
+#include "emulator.h"
+
+/********************** macros and definitions *******************************/
+/* PCF8574 wiring, as in display_pcf8574.c */
+#define PCF8574_BIT_RS  0b00000001
+#define PCF8574_BIT_RW  0b00000010
+#define PCF8574_BIT_EN  0b00000100
+#define PCF8574_BIT_EN2 PCF8574_BIT_RW
+#define PCF8574_DATA_LINES 0b11110000
+
+#define HD44780_DDRAM_LINE_2 0x40
+#define HD44780_DDRAM_LINE_LENGTH 40
+
+/********************** internal data declaration ****************************/
+static uint8_t pcf8574_port;
+static uint8_t pcf8574_read_port;
+static bool pcf8574_read_low_nibble;
+
+/********************** internal functions declaration ***********************/
+static void hd44780_execute(emulator_hd44780_t *p_hd44780, bool rs, uint8_t data);
+static void hd44780_strobe(emulator_hd44780_t *p_hd44780, uint8_t port);
+
+/********************** internal data definition *****************************/
+
+/********************** external data definition *****************************/
+emulator_hd44780_t emulator_hd44780[EMULATOR_HD44780_CONTROLLERS];
+
+/********************** internal functions definition ************************/
+static void hd44780_execute(emulator_hd44780_t *p_hd44780, bool rs, uint8_t data)
+{
+    if (rs) {
+        if (p_hd44780->cgram_selected) {
+            p_hd44780->cgram[p_hd44780->address_counter] = data & 0x1F;
+            p_hd44780->address_counter = (p_hd44780->address_counter + 1) % EMULATOR_HD44780_CGRAM_SIZE;
+            return;
+        }
+
+        p_hd44780->ddram[p_hd44780->address_counter] = data;
+        p_hd44780->address_counter++;
+        if (p_hd44780->address_counter == HD44780_DDRAM_LINE_LENGTH)
+            p_hd44780->address_counter = HD44780_DDRAM_LINE_2;
+        else if (p_hd44780->address_counter == HD44780_DDRAM_LINE_2 + HD44780_DDRAM_LINE_LENGTH)
+            p_hd44780->address_counter = 0;
+        return;
+    }
+
+    if (data & 0x80) {
+        p_hd44780->address_counter = data & 0x7F;
+        p_hd44780->cgram_selected = false;
+    }
+    else if (data & 0x40) {
+        p_hd44780->address_counter = data & 0x3F;
+        p_hd44780->cgram_selected = true;
+    }
+    else if (data & 0x20) {
+        p_hd44780->interface_4_bits = (data & 0x10) == 0;
+        p_hd44780->nibble_pending = false;
+    }
+    else if (data & 0x10) {
+        /* Cursor and display shift are not emulated */
+    }
+    else if (data & 0x08) {
+        p_hd44780->display_control = data & 0x07;
+    }
+    else if (data & 0x04) {
+        /* Entry mode, the text layer always increments */
+    }
+    else if (data & 0x02) {
+        p_hd44780->address_counter = 0;
+        p_hd44780->cgram_selected = false;
+    }
+    else if (data & 0x01) {
+        memset(p_hd44780->ddram, ' ', sizeof(p_hd44780->ddram));
+        p_hd44780->address_counter = 0;
+        p_hd44780->cgram_selected = false;
+    }
+}
+
+/* Falling edge of EN, the data lines are latched */
+static void hd44780_strobe(emulator_hd44780_t *p_hd44780, uint8_t port)
+{
+    uint8_t nibble = port & PCF8574_DATA_LINES;
+    bool rs = (port & PCF8574_BIT_RS) != 0;
+
+    if (p_hd44780->interface_4_bits == false) {
+        hd44780_execute(p_hd44780, rs, nibble);
+    }
+    else if (p_hd44780->nibble_pending == false) {
+        p_hd44780->nibble_high = nibble;
+        p_hd44780->nibble_pending = true;
+    }
+    else {
+        p_hd44780->nibble_pending = false;
+        hd44780_execute(p_hd44780, rs, p_hd44780->nibble_high | (nibble >> 4));
+    }
+}
+
+/********************** external functions definition ************************/
+void emulator_hd44780_reset(void)
+{
+    uint8_t i;
+
+    /* Power-on state: 8-bit interface, display off */
+    memset(emulator_hd44780, 0, sizeof(emulator_hd44780));
+    for (i = 0; i < EMULATOR_HD44780_CONTROLLERS; i++)
+        memset(emulator_hd44780[i].ddram, ' ', sizeof(emulator_hd44780[i].ddram));
+    pcf8574_port = 0;
+    pcf8574_read_port = 0;
+    pcf8574_read_low_nibble = false;
+}
+
+void emulator_pcf8574_write(uint8_t port)
+{
+#if (DISPLAY_CONTROLLERS > 1)
+    /* RW is the second enable line, reads are not possible */
+    if ((pcf8574_port & PCF8574_BIT_EN) && (port & PCF8574_BIT_EN) == 0)
+        hd44780_strobe(&emulator_hd44780[0], pcf8574_port);
+    if ((pcf8574_port & PCF8574_BIT_EN2) && (port & PCF8574_BIT_EN2) == 0)
+        hd44780_strobe(&emulator_hd44780[1], pcf8574_port);
+#else
+    emulator_hd44780_t *p_hd44780 = &emulator_hd44780[0];
+
+    /* Rising edge of EN with RW high drives the busy flag and the address
+     * counter on the data lines, high nibble first. Instructions complete
+     * as they are latched, so the busy flag always reads clear. */
+    if ((pcf8574_port & PCF8574_BIT_EN) == 0 && (port & PCF8574_BIT_EN) && (port & PCF8574_BIT_RW)) {
+        uint8_t status = p_hd44780->address_counter & 0x7F;
+
+        if (pcf8574_read_low_nibble == false)
+            pcf8574_read_port = (status & 0xF0) | (port & ~PCF8574_DATA_LINES);
+        else
+            pcf8574_read_port = ((status << 4) & 0xF0) | (port & ~PCF8574_DATA_LINES);
+        pcf8574_read_low_nibble = !pcf8574_read_low_nibble;
+    }
+
+    if ((pcf8574_port & PCF8574_BIT_EN) && (port & PCF8574_BIT_EN) == 0 && (pcf8574_port & PCF8574_BIT_RW) == 0)
+        hd44780_strobe(p_hd44780, pcf8574_port);
+#endif
+
+    pcf8574_port = port;
+}
+
+uint8_t emulator_pcf8574_read(void)
+{
+    return pcf8574_read_port;
+}
+
+/********************** end of file ******************************************/
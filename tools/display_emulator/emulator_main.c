@@ -0,0 +1,458 @@
+/*
+ * Copyright (c) 2023 Juan Manuel Cruz <jcruz@fi.uba.ar> <jcruz@frba.utn.edu.ar>.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ * @file   : emulator_main.c
+ * @date   : Ago 14, 2024
+ * @author : Manuel Collazo <mcollazo@fi.uba.ar>
+ * @version	v1.0.0
+ */
+
+/********************** inclusions *******************************************/
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Project includes. */
+#include "main.h"
+
+/* Application & Tasks includes. */
+#include "display.h"
+#include "display_backend.h"
+#include "graphics.h"
+#include "emulator.h"
+
+/********************** macros and definitions *******************************/
+/* Budget of the time-sliced flush scenario, TASK_SCREEN_FLUSH_BUDGET by
+ * default */
+#ifndef EMULATOR_FLUSH_BUDGET
+#define EMULATOR_FLUSH_BUDGET 12
+#endif
+
+#define EMULATOR_SETTLE_UPDATES 16
+#define EMULATOR_SLICES_MAX 10000
+
+/* Long enough for the slowest retry back-off of any backend */
+#define EMULATOR_READY_TIMEOUT_MS 5000
+
+/* Three words per row, the last one partly used, and a last page cut
+ * short */
+#define EMULATOR_GRAPHICS_WIDTH  70
+#define EMULATOR_GRAPHICS_HEIGHT 20
+#define EMULATOR_GRAPHICS_PAGES  ((EMULATOR_GRAPHICS_HEIGHT + 7) / 8)
+
+/********************** internal data declaration ****************************/
+static display_t *p_display;
+static uint32_t emulator_failures;
+static char frame_text[DISPLAY_ROWS][DISPLAY_COLUMNS + 1];
+static uint32_t graphics_words[GRAPHICS_SURFACE_WORDS(EMULATOR_GRAPHICS_WIDTH, EMULATOR_GRAPHICS_HEIGHT)];
+static graphics_surface_t graphics_surface;
+/* What the surface should hold, one pixel at a time */
+static bool graphics_model[EMULATOR_GRAPHICS_HEIGHT][EMULATOR_GRAPHICS_WIDTH];
+
+/********************** internal functions declaration ***********************/
+static void check(bool condition, const char *p_what);
+static void settle(void);
+static uint32_t ready_wait(void);
+static void report(const char *p_scenario);
+static void frame_text_set(char fill, const char *p_label);
+static void frame_text_write(void);
+static bool frame_text_is_shown(void);
+static void scenario_full_frame(void);
+static void scenario_one_cell(void);
+static void scenario_unchanged_frame(void);
+static void scenario_queued_writes(void);
+static void budget_flush(const char *p_scenario);
+static void scenario_budget(void);
+static void scenario_fault(void);
+static void graphics_model_apply(int16_t x, int16_t y, bool on, graphics_op_t op);
+static bool graphics_model_matches(void);
+static void scenario_graphics(void);
+
+/********************** internal data definition *****************************/
+
+/********************** external data definition *****************************/
+
+/********************** internal functions definition ************************/
+static void check(bool condition, const char *p_what)
+{
+    if (condition)
+        return;
+
+    printf("FAILED: %s\n", p_what);
+    emulator_failures++;
+}
+
+static void settle(void)
+{
+    uint8_t i;
+
+    /* Transfers chained from the completion callbacks included */
+    for (i = 0; i < EMULATOR_SETTLE_UPDATES; i++) {
+        display_update();
+        while (emulator_dma_is_busy())
+            display_update();
+    }
+}
+
+/* Retry back-offs are skipped through in emulated time, the controller
+ * power-up timing runs on the cycle counter in real time */
+static uint32_t ready_wait(void)
+{
+    uint32_t start = HAL_GetTick();
+
+    while (display_is_ready(p_display) == false && (HAL_GetTick() - start) < EMULATOR_READY_TIMEOUT_MS) {
+        if (display_backend_is_healthy() == false)
+            emulator_tick_advance(1);
+        display_update();
+    }
+    settle();
+    return HAL_GetTick() - start;
+}
+
+static void report(const char *p_scenario)
+{
+    printf("%-18s bytes %5u  transfers %4u  largest transfer %4u\n", p_scenario,
+           emulator_bus_stats.bytes, emulator_bus_stats.transfers, emulator_bus_stats.transfer_bytes_max);
+}
+
+static void frame_text_set(char fill, const char *p_label)
+{
+    uint8_t row;
+
+    for (row = 0; row < DISPLAY_ROWS; row++) {
+        memset(frame_text[row], fill, DISPLAY_COLUMNS);
+        frame_text[row][DISPLAY_COLUMNS] = '\0';
+        snprintf(frame_text[row], DISPLAY_COLUMNS + 1, "%c%s %u", row == 0 ? '>' : ' ', p_label, row + 1);
+        if (strlen(frame_text[row]) < DISPLAY_COLUMNS)
+            frame_text[row][strlen(frame_text[row])] = fill;
+    }
+}
+
+static void frame_text_write(void)
+{
+    uint8_t row;
+
+    for (row = 0; row < DISPLAY_ROWS; row++)
+        display_frame_string_write(p_display, 0, row, frame_text[row]);
+}
+
+#if (DISPLAY_BACKEND == DISPLAY_BACKEND_SSD1306)
+/* Pixels are not decoded, a text row only has to have some set */
+static bool frame_text_is_shown(void)
+{
+    uint8_t row, column, lit;
+
+    for (row = 0; row < DISPLAY_ROWS; row++) {
+        lit = 0;
+        for (column = 0; column < EMULATOR_SSD1306_WIDTH; column++)
+            lit |= emulator_ssd1306.ram[row * (EMULATOR_SSD1306_PAGES / DISPLAY_ROWS)][column];
+        if (lit == 0)
+            return false;
+    }
+    return emulator_ssd1306.display_on;
+}
+#else
+static bool frame_text_is_shown(void)
+{
+    uint8_t row;
+
+    for (row = 0; row < DISPLAY_ROWS; row++) {
+        const emulator_hd44780_t *p_hd44780 = &emulator_hd44780[display_geometry.row_controller[row]];
+
+        if (memcmp(&p_hd44780->ddram[display_geometry.row_address[row]], frame_text[row], DISPLAY_COLUMNS) != 0)
+            return false;
+    }
+    return true;
+}
+#endif
+
+static void scenario_full_frame(void)
+{
+    frame_text_set(' ', "Menu Item");
+    frame_text_write();
+    emulator_bus_stats_clear();
+    display_frame_flush(p_display);
+    settle();
+    report("full frame");
+    check(frame_text_is_shown(), "full frame shown");
+}
+
+static void scenario_one_cell(void)
+{
+    frame_text[0][0] = ' ';
+    frame_text[1][0] = '>';
+    frame_text_write();
+    emulator_bus_stats_clear();
+    display_frame_flush(p_display);
+    settle();
+    report("selection moved");
+    check(frame_text_is_shown(), "selection moved shown");
+}
+
+static void scenario_unchanged_frame(void)
+{
+    frame_text_write();
+    emulator_bus_stats_clear();
+    display_frame_flush(p_display);
+    settle();
+    report("unchanged frame");
+    check(emulator_bus_stats.bytes == 0, "unchanged frame costs nothing");
+}
+
+/* Direct writes right behind a full frame, while its bursts still wait
+ * for the bus, so the transfer queue runs full */
+static void scenario_queued_writes(void)
+{
+    static const char queued[] = "Queued";
+
+    frame_text_set('-', "Queue");
+    frame_text_write();
+    emulator_bus_stats_clear();
+    display_frame_flush(p_display);
+    display_char_position_write(p_display, 0, 1);
+    display_string_write(p_display, queued);
+    memcpy(frame_text[1], queued, strlen(queued));
+    display_char_position_write(p_display, 0, DISPLAY_ROWS - 1);
+    display_string_write(p_display, queued);
+    memcpy(frame_text[DISPLAY_ROWS - 1], queued, strlen(queued));
+    settle();
+    report("queued writes");
+    check(frame_text_is_shown(), "queued writes shown");
+}
+
+/* Same flush as task_screen with TASK_SCREEN_FLUSH_BUDGET, one slice per
+ * superloop pass */
+static void budget_flush(const char *p_scenario)
+{
+    uint32_t slices = 0, slice_bytes_max = 0, bytes = 0;
+    uint32_t budget = (EMULATOR_FLUSH_BUDGET < DISPLAY_FLUSH_BUDGET_MIN) ? DISPLAY_FLUSH_BUDGET_MIN : EMULATOR_FLUSH_BUDGET;
+    bool done = false;
+
+    frame_text_write();
+    while (done == false && slices < EMULATOR_SLICES_MAX) {
+        emulator_bus_stats_clear();
+        done = display_frame_flush_budget(p_display, EMULATOR_FLUSH_BUDGET);
+        settle();
+        slices++;
+        bytes += emulator_bus_stats.bytes;
+        if (slice_bytes_max < emulator_bus_stats.bytes)
+            slice_bytes_max = emulator_bus_stats.bytes;
+    }
+
+    printf("%-18s bytes %5u  slices %7u  largest slice %4u\n", p_scenario, bytes, slices, slice_bytes_max);
+    check(done, "budgeted flush completes");
+    check(slice_bytes_max <= budget, "slices within the budget");
+    check(frame_text_is_shown(), "budgeted frame shown");
+}
+
+static void scenario_budget(void)
+{
+    uint8_t row;
+
+    /* Every cell, one run per row */
+    frame_text_set('.', "Budget");
+    budget_flush("budget, full");
+
+    /* One cell per row, every one behind an address command */
+    for (row = 0; row < DISPLAY_ROWS; row++)
+        frame_text[row][DISPLAY_COLUMNS / 2] = '*';
+    budget_flush("budget, sparse");
+
+    /* The unbudgeted flush of the full change, for comparison */
+    frame_text_set(' ', "Menu Item");
+    frame_text_write();
+    display_frame_flush(p_display);
+    settle();
+    frame_text_set('.', "Budget");
+    frame_text_write();
+    emulator_bus_stats_clear();
+    display_frame_flush(p_display);
+    settle();
+    report("full, unbudgeted");
+}
+
+/* The bus fails under a pending change, the controller loses its state,
+ * and the frame has to come back once the bus answers again */
+static void scenario_fault(void)
+{
+    uint32_t recoveries = emulator_bus_recoveries;
+    uint32_t ready_ms;
+#if (DISPLAY_BACKEND == DISPLAY_BACKEND_SSD1306)
+    uint8_t ram[EMULATOR_SSD1306_PAGES][EMULATOR_SSD1306_WIDTH];
+    char character;
+#endif
+
+    frame_text_set(' ', "Recovered");
+
+    emulator_bus_is_failing = true;
+    frame_text_write();
+    display_frame_flush(p_display);
+    settle();
+    check(display_is_ready(p_display) == false, "fault detected");
+
+    emulator_hd44780_reset();
+    emulator_ssd1306_reset();
+    emulator_bus_is_failing = false;
+
+    ready_ms = ready_wait();
+    check(display_is_ready(p_display), "bus recovered");
+    printf("%-18s bus re-initialised %u times, ready after %u ms\n", "fault recovery",
+           emulator_bus_recoveries - recoveries, ready_ms);
+    check(emulator_bus_recoveries > recoveries, "bus re-initialised");
+    check(frame_text_is_shown(), "frame restored");
+
+#if (DISPLAY_BACKEND == DISPLAY_BACKEND_SSD1306)
+    /* The recovery repainted every page. A cell changed and changed back
+     * through incremental updates has to leave the same pixels. */
+    memcpy(ram, emulator_ssd1306.ram, sizeof(ram));
+    character = frame_text[DISPLAY_ROWS - 1][3];
+    frame_text[DISPLAY_ROWS - 1][3] = '#';
+    frame_text_write();
+    display_frame_flush(p_display);
+    settle();
+    frame_text[DISPLAY_ROWS - 1][3] = character;
+    frame_text_write();
+    display_frame_flush(p_display);
+    settle();
+    check(memcmp(ram, emulator_ssd1306.ram, sizeof(ram)) == 0, "incremental pixels match a full repaint");
+#endif
+}
+
+static void graphics_model_apply(int16_t x, int16_t y, bool on, graphics_op_t op)
+{
+    if (x < 0 || y < 0 || x >= EMULATOR_GRAPHICS_WIDTH || y >= EMULATOR_GRAPHICS_HEIGHT)
+        return;
+
+    switch (op) {
+    case GRAPHICS_OP_SET:   graphics_model[y][x] |= on; break;
+    case GRAPHICS_OP_CLEAR: graphics_model[y][x] &= !on; break;
+    case GRAPHICS_OP_XOR:   graphics_model[y][x] ^= on; break;
+    case GRAPHICS_OP_COPY:  graphics_model[y][x] = on; break;
+    }
+}
+
+static bool graphics_model_matches(void)
+{
+    int16_t x, y;
+
+    for (y = 0; y < EMULATOR_GRAPHICS_HEIGHT; y++)
+        for (x = 0; x < EMULATOR_GRAPHICS_WIDTH; x++)
+            if (graphics_pixel_get(&graphics_surface, x, y) != graphics_model[y][x])
+                return false;
+    return true;
+}
+
+/* The word-at-a-time drawing and the page transpose against a pixel by
+ * pixel model, on no display */
+static void scenario_graphics(void)
+{
+    static const uint8_t glyph[8] = { 0x1C, 0x22, 0x41, 0x7F, 0x41, 0x41, 0x41, 0x00 };
+    uint8_t columns[EMULATOR_GRAPHICS_WIDTH];
+    int16_t x, y, row, column;
+    uint8_t page;
+    bool is_packed = true;
+
+    graphics_surface_init(&graphics_surface, graphics_words, EMULATOR_GRAPHICS_WIDTH, EMULATOR_GRAPHICS_HEIGHT);
+    graphics_fill(&graphics_surface, false);
+    memset(graphics_model, 0, sizeof(graphics_model));
+
+    /* Masked words at both ends and a whole one between them, then a fill
+     * across a word boundary */
+    graphics_rect_fill(&graphics_surface, 5, 2, 60, 5, GRAPHICS_OP_SET);
+    for (y = 2; y < 7; y++)
+        for (x = 5; x < 65; x++)
+            graphics_model_apply(x, y, true, GRAPHICS_OP_SET);
+    graphics_rect_fill(&graphics_surface, 30, 4, 4, 10, GRAPHICS_OP_XOR);
+    for (y = 4; y < 14; y++)
+        for (x = 30; x < 34; x++)
+            graphics_model_apply(x, y, true, GRAPHICS_OP_XOR);
+    check(graphics_model_matches(), "rect fill pixels");
+
+    /* Straddling two words over the fills, then clipped at the right and
+     * bottom edges */
+    graphics_glyph_draw(&graphics_surface, 28, 3, glyph, 7, 8, GRAPHICS_OP_COPY);
+    for (row = 0; row < 8; row++)
+        for (column = 0; column < 7; column++)
+            graphics_model_apply(28 + column, 3 + row, (glyph[row] >> column) & 1, GRAPHICS_OP_COPY);
+    graphics_glyph_draw(&graphics_surface, 66, 15, glyph, 7, 8, GRAPHICS_OP_SET);
+    for (row = 0; row < 8; row++)
+        for (column = 0; column < 7; column++)
+            graphics_model_apply(66 + column, 15 + row, (glyph[row] >> column) & 1, GRAPHICS_OP_SET);
+    check(graphics_model_matches(), "glyph pixels");
+
+    /* Bit 0 of a column on top, rows below the surface clear */
+    for (page = 0; page < EMULATOR_GRAPHICS_PAGES; page++) {
+        graphics_page_pack(&graphics_surface, page, columns);
+        for (x = 0; x < EMULATOR_GRAPHICS_WIDTH; x++)
+            for (row = 0; row < 8; row++) {
+                y = page * 8 + row;
+                if (((columns[x] >> row) & 1) != (y < EMULATOR_GRAPHICS_HEIGHT && graphics_model[y][x]))
+                    is_packed = false;
+            }
+    }
+    check(is_packed, "page pack matches the pixels");
+}
+
+/********************** external functions definition ************************/
+int main(void)
+{
+    emulator_init();
+    emulator_dma_is_deferred = true;
+
+    printf("backend %s, %ux%u, flush budget %u\n",
+           (DISPLAY_BACKEND == DISPLAY_BACKEND_SSD1306) ? "SSD1306" : "PCF8574",
+           DISPLAY_COLUMNS, DISPLAY_ROWS, EMULATOR_FLUSH_BUDGET);
+
+    p_display = display_init(DISPLAY_ADDRESS_DEFAULT);
+    ready_wait();
+    check(display_is_ready(p_display), "display ready");
+    report("power-up");
+
+    scenario_full_frame();
+    scenario_one_cell();
+    scenario_unchanged_frame();
+    scenario_queued_writes();
+    scenario_budget();
+    scenario_fault();
+    scenario_graphics();
+
+    if (emulator_failures != 0) {
+        printf("%u checks failed\n", emulator_failures);
+        return EXIT_FAILURE;
+    }
+    printf("all checks passed\n");
+    return EXIT_SUCCESS;
+}
+
+/********************** end of file ******************************************/
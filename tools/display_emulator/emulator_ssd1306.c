@@ -0,0 +1,131 @@
+/*
+ * Copyright (c) 2023 Juan Manuel Cruz <jcruz@fi.uba.ar> <jcruz@frba.utn.edu.ar>.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ * @file   : emulator_ssd1306.c
+ * @date   : Ago 14, 2024
+ * @author : Manuel Collazo <mcollazo@fi.uba.ar>
+ * @version	v1.0.0
+ */
+
+/********************** inclusions *******************************************/
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+/* Application & Tasks includes. */
+#include "emulator.h"
+
+/********************** macros and definitions *******************************/
+#define SSD1306_CONTROL_DATA 0x40
+
+#define SSD1306_CMD_DISPLAY_OFF    0xAE
+#define SSD1306_CMD_DISPLAY_ON     0xAF
+#define SSD1306_CMD_COLUMN_ADDRESS 0x21
+#define SSD1306_CMD_PAGE_ADDRESS   0x22
+
+/********************** internal data declaration ****************************/
+
+/********************** internal functions declaration ***********************/
+static void ssd1306_command_execute(const uint8_t *p_data, uint16_t length);
+static void ssd1306_data_write(const uint8_t *p_data, uint16_t length);
+
+/********************** internal data definition *****************************/
+
+/********************** external data definition *****************************/
+emulator_ssd1306_t emulator_ssd1306;
+
+/********************** internal functions definition ************************/
+static void ssd1306_command_execute(const uint8_t *p_data, uint16_t length)
+{
+    emulator_ssd1306_t *p_ssd1306 = &emulator_ssd1306;
+    uint16_t i;
+
+    for (i = 0; i < length; i++) {
+        switch (p_data[i]) {
+            case SSD1306_CMD_DISPLAY_OFF:
+            case SSD1306_CMD_DISPLAY_ON:
+                p_ssd1306->display_on = p_data[i] == SSD1306_CMD_DISPLAY_ON;
+                break;
+            case SSD1306_CMD_COLUMN_ADDRESS:
+                p_ssd1306->column_first = p_ssd1306->column = p_data[i + 1];
+                p_ssd1306->column_last = p_data[i + 2];
+                i += 2;
+                break;
+            case SSD1306_CMD_PAGE_ADDRESS:
+                p_ssd1306->page_first = p_ssd1306->page = p_data[i + 1];
+                p_ssd1306->page_last = p_data[i + 2];
+                i += 2;
+                break;
+            /* Commands with one argument byte, their settings are not emulated */
+            case 0xD5: case 0xA8: case 0xD3: case 0x8D: case 0x20:
+            case 0xDA: case 0x81: case 0xD9: case 0xDB:
+                i++;
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+/* Horizontal addressing inside the column and page window */
+static void ssd1306_data_write(const uint8_t *p_data, uint16_t length)
+{
+    emulator_ssd1306_t *p_ssd1306 = &emulator_ssd1306;
+    uint16_t i;
+
+    for (i = 0; i < length; i++) {
+        p_ssd1306->ram[p_ssd1306->page][p_ssd1306->column] = p_data[i];
+        if (++p_ssd1306->column > p_ssd1306->column_last) {
+            p_ssd1306->column = p_ssd1306->column_first;
+            if (++p_ssd1306->page > p_ssd1306->page_last)
+                p_ssd1306->page = p_ssd1306->page_first;
+        }
+    }
+}
+
+/********************** external functions definition ************************/
+void emulator_ssd1306_reset(void)
+{
+    memset(&emulator_ssd1306, 0, sizeof(emulator_ssd1306));
+    emulator_ssd1306.column_last = EMULATOR_SSD1306_WIDTH - 1;
+    emulator_ssd1306.page_last = EMULATOR_SSD1306_PAGES - 1;
+}
+
+void emulator_ssd1306_write(uint8_t control, const uint8_t *p_data, uint16_t length)
+{
+    if (control == SSD1306_CONTROL_DATA)
+        ssd1306_data_write(p_data, length);
+    else
+        ssd1306_command_execute(p_data, length);
+}
+
+/********************** end of file ******************************************/